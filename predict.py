@@ -46,7 +46,8 @@ class Box(Structure):
         ('right', c_int),
         ('bottom', c_int),
         ('class_num', c_int),
-        ('conf', c_float)]
+        ('conf', c_float),
+        ('track_id', c_int)]
 
 
 class BoxArray(Structure):
@@ -133,6 +134,18 @@ def initialize(weights_path, hypes_path, options=None):
     else:
         mydll.initialize_network_test(path.join(param_folder, str(config['yolo']['model_def_path'])), path.join(param_folder, str(weights_path)))
 
+    # dynamic_input: true keeps the cfg pixel budget, a number sets the budget explicitly
+    dynamic_input = config['yolo'].get('dynamic_input', False)
+    if 'pred_options' in config and 'dynamic_input' in config['pred_options']:
+        dynamic_input = config['pred_options']['dynamic_input']
+    if dynamic_input:
+        budget = -1 if dynamic_input is True else int(dynamic_input)
+        mydll.set_dynamic_input(c_int(budget))
+
+    # track: true smooths boxes over consecutive hot_predict calls on the frames of one video
+    if config['yolo'].get('track', False):
+        mydll.set_tracking(c_int(1))
+
     result = {'dll' : mydll, 'thresh': config['yolo']['thresh'], 'hier_thresh': config['yolo']['hier_thresh'],
               'sliding_predict': config['sliding_predict']}
 
@@ -261,6 +274,8 @@ def process_result_boxes(pred_boxes, init_params, margin=0):
         box['x2'] = pred_boxes.arr[ind].right
         box['y2'] = pred_boxes.arr[ind].bottom + margin
         box['conf'] = pred_boxes.arr[ind].conf
+        if pred_boxes.arr[ind].track_id:
+            box['track_id'] = pred_boxes.arr[ind].track_id
 
         if 'classID' in init_params:
             box['classID'] = init_params['classID']
@@ -35,6 +35,20 @@ layer make_activation_layer(int batch, int inputs, ACTIVATION activation)
     return l;
 }
 
+void resize_activation_layer(layer *l, int inputs)
+{
+    l->inputs = inputs;
+    l->outputs = inputs;
+    l->output = realloc(l->output, inputs*l->batch*sizeof(float));
+    l->delta = realloc(l->delta, inputs*l->batch*sizeof(float));
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    l->output_gpu = cuda_make_array(l->output, inputs*l->batch);
+    l->delta_gpu = cuda_make_array(l->delta, inputs*l->batch);
+#endif
+}
+
 void forward_activation_layer(layer l, network net)
 {
     copy_cpu(l.outputs*l.batch, net.input, 1, l.output, 1);
@@ -9,6 +9,7 @@ layer make_activation_layer(int batch, int inputs, ACTIVATION activation);
 
 void forward_activation_layer(layer l, network net);
 void backward_activation_layer(layer l, network net);
+void resize_activation_layer(layer *l, int inputs);
 
 #ifdef GPU
 void forward_activation_layer_gpu(layer l, network net);
@@ -3,7 +3,7 @@
 #include "blas.h"
 #include <stdio.h>
 
-layer make_batchnorm_layer(int batch, int w, int h, int c)
+layer make_batchnorm_layer(int batch, int w, int h, int c, int train)
 {
     fprintf(stderr, "Batch Normalization Layer: %d x %d x %d image\n", w,h,c);
     layer l = {0};
@@ -13,25 +13,28 @@ layer make_batchnorm_layer(int batch, int w, int h, int c)
     l.w = l.out_w = w;
     l.c = l.out_c = c;
     l.output = calloc(h * w * c * batch, sizeof(float));
-    l.delta  = calloc(h * w * c * batch, sizeof(float));
+    if(train) l.delta  = calloc(h * w * c * batch, sizeof(float));
     l.inputs = w*h*c;
     l.outputs = l.inputs;
 
     l.scales = calloc(c, sizeof(float));
-    l.scale_updates = calloc(c, sizeof(float));
     l.biases = calloc(c, sizeof(float));
-    l.bias_updates = calloc(c, sizeof(float));
     int i;
     for(i = 0; i < c; ++i){
         l.scales[i] = 1;
     }
 
-    l.mean = calloc(c, sizeof(float));
-    l.variance = calloc(c, sizeof(float));
-
     l.rolling_mean = calloc(c, sizeof(float));
     l.rolling_variance = calloc(c, sizeof(float));
 
+    if(train){
+        l.scale_updates = calloc(c, sizeof(float));
+        l.bias_updates = calloc(c, sizeof(float));
+
+        l.mean = calloc(c, sizeof(float));
+        l.variance = calloc(c, sizeof(float));
+    }
+
     l.forward = forward_batchnorm_layer;
     l.backward = backward_batchnorm_layer;
 #ifdef GPU
@@ -39,25 +42,27 @@ layer make_batchnorm_layer(int batch, int w, int h, int c)
     l.backward_gpu = backward_batchnorm_layer_gpu;
 
     l.output_gpu =  cuda_make_array(l.output, h * w * c * batch);
-    l.delta_gpu =   cuda_make_array(l.delta, h * w * c * batch);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, h * w * c * batch);
 
     l.biases_gpu = cuda_make_array(l.biases, c);
-    l.bias_updates_gpu = cuda_make_array(l.bias_updates, c);
-
     l.scales_gpu = cuda_make_array(l.scales, c);
-    l.scale_updates_gpu = cuda_make_array(l.scale_updates, c);
 
-    l.mean_gpu = cuda_make_array(l.mean, c);
-    l.variance_gpu = cuda_make_array(l.variance, c);
+    l.rolling_mean_gpu = cuda_make_array(l.rolling_mean, c);
+    l.rolling_variance_gpu = cuda_make_array(l.rolling_variance, c);
 
-    l.rolling_mean_gpu = cuda_make_array(l.mean, c);
-    l.rolling_variance_gpu = cuda_make_array(l.variance, c);
+    if(train){
+        l.bias_updates_gpu = cuda_make_array(l.bias_updates, c);
+        l.scale_updates_gpu = cuda_make_array(l.scale_updates, c);
 
-    l.mean_delta_gpu = cuda_make_array(l.mean, c);
-    l.variance_delta_gpu = cuda_make_array(l.variance, c);
+        l.mean_gpu = cuda_make_array(l.mean, c);
+        l.variance_gpu = cuda_make_array(l.variance, c);
 
-    l.x_gpu = cuda_make_array(l.output, l.batch*l.outputs);
-    l.x_norm_gpu = cuda_make_array(l.output, l.batch*l.outputs);
+        l.mean_delta_gpu = cuda_make_array(l.mean, c);
+        l.variance_delta_gpu = cuda_make_array(l.variance, c);
+
+        l.x_gpu = cuda_make_array(l.output, l.batch*l.outputs);
+        l.x_norm_gpu = cuda_make_array(l.output, l.batch*l.outputs);
+    }
     #ifdef CUDNN
     cudnnCreateTensorDescriptor(&l.normTensorDesc);
     cudnnCreateTensorDescriptor(&l.dstTensorDesc);
@@ -127,9 +132,102 @@ void normalize_delta_cpu(float *x, float *mean, float *variance, float *mean_del
     }
 }
 
-void resize_batchnorm_layer(layer *layer, int w, int h)
+void resize_batchnorm_layer(layer *l, int w, int h)
 {
-    fprintf(stderr, "Not implemented\n");
+    l->w = l->out_w = w;
+    l->h = l->out_h = h;
+    l->inputs = w*h*l->c;
+    l->outputs = l->inputs;
+    int output_size = l->outputs*l->batch;
+
+    l->output = realloc(l->output, output_size*sizeof(float));
+    if(l->delta) l->delta = realloc(l->delta, output_size*sizeof(float));
+
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    l->output_gpu = cuda_make_array(l->output, output_size);
+    if(l->delta_gpu){
+        cuda_free(l->delta_gpu);
+        l->delta_gpu = cuda_make_array(l->delta, output_size);
+    }
+    if(l->x_gpu){
+        cuda_free(l->x_gpu);
+        cuda_free(l->x_norm_gpu);
+        l->x_gpu = cuda_make_array(l->output, output_size);
+        l->x_norm_gpu = cuda_make_array(l->output, output_size);
+    }
+#endif
+}
+
+/* normalize_cpu, scale_bias and add_bias in one pass, saving the normalized values when x_norm is set. */
+static void normalize_scale_bias_cpu(float *x, float *mean, float *variance, float *scales, float *biases,
+        int batch, int filters, int spatial, float *x_norm)
+{
+    int b, f, i;
+    for(b = 0; b < batch; ++b){
+        for(f = 0; f < filters; ++f){
+            int offset = (b*filters + f)*spatial;
+            float *row = x + offset;
+            float m = mean[f];
+            float inv = 1./(sqrt(variance[f]) + .000001f);
+            float s = scales[f];
+            float bias = biases[f];
+            if(x_norm){
+                float *norm = x_norm + offset;
+                for(i = 0; i < spatial; ++i){
+                    norm[i] = (row[i] - m)*inv;
+                    row[i] = norm[i]*s + bias;
+                }
+            } else {
+                for(i = 0; i < spatial; ++i) row[i] = (row[i] - m)*inv*s + bias;
+            }
+        }
+    }
+}
+
+/* backward_bias, backward_scale_cpu, scale_bias, mean_delta_cpu, variance_delta_cpu and
+   normalize_delta_cpu as one pass gathering the per-filter sums and one pass applying them. */
+static void batchnorm_delta_cpu(layer l, float *mean, float *variance)
+{
+    int b, f, i;
+    int filters = l.out_c;
+    int spatial = l.out_w*l.out_h;
+    float n = spatial*l.batch;
+    for(f = 0; f < filters; ++f) l.mean_delta[f] = l.variance_delta[f] = 0;
+    for(b = 0; b < l.batch; ++b){
+        for(f = 0; f < filters; ++f){
+            int offset = (b*filters + f)*spatial;
+            float *delta = l.delta + offset;
+            float *x = l.x + offset;
+            float *x_norm = l.x_norm + offset;
+            float m = mean[f];
+            float sum = 0, scaled = 0, centered = 0;
+            for(i = 0; i < spatial; ++i){
+                sum += delta[i];
+                scaled += delta[i]*x_norm[i];
+                centered += delta[i]*(x[i] - m);
+            }
+            l.bias_updates[f] += sum;
+            l.scale_updates[f] += scaled;
+            l.mean_delta[f] += sum;
+            l.variance_delta[f] += centered;
+        }
+    }
+    for(f = 0; f < filters; ++f){
+        l.mean_delta[f] *= l.scales[f]*(-1./sqrt(variance[f] + .00001f));
+        l.variance_delta[f] *= l.scales[f]*(-.5 * pow(variance[f] + .00001f, (float)(-3./2.)));
+    }
+    for(b = 0; b < l.batch; ++b){
+        for(f = 0; f < filters; ++f){
+            float *delta = l.delta + (b*filters + f)*spatial;
+            float *x = l.x + (b*filters + f)*spatial;
+            float m = mean[f];
+            float a = l.scales[f]/sqrt(variance[f] + .00001f);
+            float v = l.variance_delta[f]*2./n;
+            float c = l.mean_delta[f]/n;
+            for(i = 0; i < spatial; ++i) delta[i] = delta[i]*a + v*(x[i] - m) + c;
+        }
+    }
 }
 
 void forward_batchnorm_layer(layer l, network net)
@@ -139,23 +237,19 @@ void forward_batchnorm_layer(layer l, network net)
         l.out_c = l.outputs;
         l.out_h = l.out_w = 1;
     }
-    copy_cpu(l.outputs*l.batch, l.output, 1, l.x, 1);
+    if(l.x) copy_cpu(l.outputs*l.batch, l.output, 1, l.x, 1);
     if(net.train){
-        mean_cpu(l.output, l.batch, l.out_c, l.out_h*l.out_w, l.mean);
-        variance_cpu(l.output, l.mean, l.batch, l.out_c, l.out_h*l.out_w, l.variance);
+        mean_variance_cpu(l.output, l.batch, l.out_c, l.out_h*l.out_w, l.mean, l.variance);
 
         scal_cpu(l.out_c, .99, l.rolling_mean, 1);
         axpy_cpu(l.out_c, .01, l.mean, 1, l.rolling_mean, 1);
         scal_cpu(l.out_c, .99, l.rolling_variance, 1);
         axpy_cpu(l.out_c, .01, l.variance, 1, l.rolling_variance, 1);
 
-        normalize_cpu(l.output, l.mean, l.variance, l.batch, l.out_c, l.out_h*l.out_w);   
-        copy_cpu(l.outputs*l.batch, l.output, 1, l.x_norm, 1);
+        normalize_scale_bias_cpu(l.output, l.mean, l.variance, l.scales, l.biases, l.batch, l.out_c, l.out_h*l.out_w, l.x_norm);
     } else {
-        normalize_cpu(l.output, l.rolling_mean, l.rolling_variance, l.batch, l.out_c, l.out_h*l.out_w);
+        normalize_scale_bias_cpu(l.output, l.rolling_mean, l.rolling_variance, l.scales, l.biases, l.batch, l.out_c, l.out_h*l.out_w, 0);
     }
-    scale_bias(l.output, l.scales, l.batch, l.out_c, l.out_h*l.out_w);
-    add_bias(l.output, l.biases, l.batch, l.out_c, l.out_h*l.out_w);
 }
 
 void backward_batchnorm_layer(layer l, network net)
@@ -164,14 +258,7 @@ void backward_batchnorm_layer(layer l, network net)
         l.mean = l.rolling_mean;
         l.variance = l.rolling_variance;
     }
-    backward_bias(l.bias_updates, l.delta, l.batch, l.out_c, l.out_w*l.out_h);
-    backward_scale_cpu(l.x_norm, l.delta, l.batch, l.out_c, l.out_w*l.out_h, l.scale_updates);
-
-    scale_bias(l.delta, l.scales, l.batch, l.out_c, l.out_h*l.out_w);
-
-    mean_delta_cpu(l.delta, l.variance, l.batch, l.out_c, l.out_w*l.out_h, l.mean_delta);
-    variance_delta_cpu(l.x, l.delta, l.mean, l.variance, l.batch, l.out_c, l.out_w*l.out_h, l.variance_delta);
-    normalize_delta_cpu(l.x, l.mean, l.variance, l.mean_delta, l.variance_delta, l.batch, l.out_c, l.out_w*l.out_h, l.delta);
+    batchnorm_delta_cpu(l, l.mean, l.variance);
     if(l.type == BATCHNORM) copy_cpu(l.outputs*l.batch, l.delta, 1, net.delta, 1);
 }
 
@@ -197,7 +284,7 @@ void forward_batchnorm_layer_gpu(layer l, network net)
         l.out_c = l.outputs;
         l.out_h = l.out_w = 1;
     }
-    copy_ongpu(l.outputs*l.batch, l.output_gpu, 1, l.x_gpu, 1);
+    if(l.x_gpu) copy_ongpu(l.outputs*l.batch, l.output_gpu, 1, l.x_gpu, 1);
     if (net.train) {
 #ifdef CUDNN
         float one = 1;
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "network.h"
+#include "parser.h"
+#include "utils.h"
+#include "gemm.h"
+#include "im2col.h"
+#include "maxpool_layer.h"
+#include "activations.h"
+#include "image.h"
+#include "box.h"
+
+typedef void (*bench_fn)(void *);
+
+typedef struct{
+    int reps;
+    int warmup;
+    double budget;
+    char *only;
+    FILE *out;
+} bench_config;
+
+typedef struct{
+    int M, N, K;
+    float *a, *b, *c;
+} gemm_bench;
+
+typedef struct{
+    float *im;
+    int c, h, w, size, stride, pad;
+    float *col;
+} im2col_bench;
+
+typedef struct{
+    layer l;
+    network net;
+} layer_bench;
+
+typedef struct{
+    float *x;
+    int n;
+    ACTIVATION a;
+} activation_bench;
+
+typedef struct{
+    image im;
+    int w, h;
+} resize_bench;
+
+typedef struct{
+    box *boxes;
+    float **probs;
+    float *orig;
+    int total, classes;
+} nms_bench;
+
+static void bench_gemm(void *p)
+{
+    gemm_bench *g = p;
+    gemm(0,0,g->M,g->N,g->K,1,g->a,g->K,g->b,g->N,1,g->c,g->N);
+}
+
+static void bench_im2col(void *p)
+{
+    im2col_bench *b = p;
+    im2col_cpu(b->im, b->c, b->h, b->w, b->size, b->stride, b->pad, b->col);
+}
+
+static void bench_maxpool(void *p)
+{
+    layer_bench *b = p;
+    forward_maxpool_layer(b->l, b->net);
+}
+
+static void bench_activation(void *p)
+{
+    activation_bench *b = p;
+    activate_array(b->x, b->n, b->a);
+}
+
+static void bench_resize(void *p)
+{
+    resize_bench *b = p;
+    image r = resize_image(b->im, b->w, b->h);
+    free_image(r);
+}
+
+static void bench_nms(void *p)
+{
+    nms_bench *b = p;
+    int i;
+    for(i = 0; i < b->total; ++i){
+        memcpy(b->probs[i], b->orig + i*(b->classes+1), (b->classes+1)*sizeof(float));
+    }
+    do_nms_sort(b->boxes, b->probs, b->total, b->classes, .45);
+}
+
+static void bench_forward(void *p)
+{
+    layer_bench *b = p;
+    network_predict(b->net, b->net.input);
+}
+
+static float *random_array(int n)
+{
+    int i;
+    float *x = calloc(n, sizeof(float));
+    for(i = 0; i < n; ++i) x[i] = rand_uniform(-1, 1);
+    return x;
+}
+
+static int double_comparator(const void *pa, const void *pb)
+{
+    double a = *(double *)pa;
+    double b = *(double *)pb;
+    return (a > b) - (a < b);
+}
+
+static double percentile(double *sorted, int n, float p)
+{
+    int i = (int)ceil(p*n) - 1;
+    if(i < 0) i = 0;
+    if(i >= n) i = n-1;
+    return sorted[i];
+}
+
+void run_bench_case(bench_config cfg, char *name, bench_fn f, void *arg, double flops)
+{
+    if(cfg.only && !strstr(name, cfg.only)) return;
+    int i;
+    for(i = 0; i < cfg.warmup; ++i) f(arg);
+
+    double *times = calloc(cfg.reps, sizeof(double));
+    double start = get_wall_time();
+    int n = 0;
+    while(n < cfg.reps){
+        double t = get_wall_time();
+        f(arg);
+        times[n++] = get_wall_time() - t;
+        if(n >= 3 && get_wall_time() - start > cfg.budget) break;
+    }
+    qsort(times, n, sizeof(double), double_comparator);
+    double mean = 0;
+    for(i = 0; i < n; ++i) mean += times[i];
+    mean /= n;
+    double p50 = percentile(times, n, .5);
+    double gflops = flops ? flops/p50/1e9 : 0;
+
+    printf("%-40s %5d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %9.2f\n", name, n,
+            1000*times[0], 1000*p50, 1000*percentile(times, n, .9), 1000*percentile(times, n, .99),
+            1000*times[n-1], 1000*mean, gflops);
+    fflush(stdout);
+    if(cfg.out){
+        fprintf(cfg.out, "{\"name\":\"%s\",\"runs\":%d,\"min_ms\":%f,\"p50_ms\":%f,\"p90_ms\":%f,\"p99_ms\":%f,\"max_ms\":%f,\"mean_ms\":%f,\"gflops\":%f}\n",
+                name, n, 1000*times[0], 1000*p50, 1000*percentile(times, n, .9), 1000*percentile(times, n, .99),
+                1000*times[n-1], 1000*mean, gflops);
+        fflush(cfg.out);
+    }
+    free(times);
+}
+
+static int seen_shape(int *shapes, int n, int a, int b, int c)
+{
+    int i;
+    for(i = 0; i < n; ++i){
+        if(shapes[3*i] == a && shapes[3*i+1] == b && shapes[3*i+2] == c) return 1;
+    }
+    return 0;
+}
+
+void bench_kernels(bench_config cfg, network net)
+{
+    char name[256];
+    int i;
+    int *shapes = calloc(3*net.n, sizeof(int));
+    int nshapes = 0;
+    for(i = 0; i < net.n; ++i){
+        layer l = net.layers[i];
+        if(l.type != CONVOLUTIONAL) continue;
+        int M = l.n/l.groups, N = l.out_w*l.out_h, K = l.size*l.size*l.c/l.groups;
+        if(seen_shape(shapes, nshapes, M, N, K)) continue;
+        shapes[3*nshapes] = M; shapes[3*nshapes+1] = N; shapes[3*nshapes+2] = K;
+        ++nshapes;
+
+        gemm_bench g = {M, N, K, random_array(M*K), random_array(K*N), random_array(M*N)};
+        sprintf(name, "gemm %dx%dx%d", M, N, K);
+        run_bench_case(cfg, name, bench_gemm, &g, 2.*M*N*K);
+        free(g.a); free(g.b); free(g.c);
+
+        if(l.size == 1 && l.stride == 1 && l.pad == 0) continue;
+        im2col_bench b = {random_array(l.c/l.groups*l.h*l.w), l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, random_array(N*K)};
+        sprintf(name, "im2col %dx%dx%d k%d s%d", l.w, l.h, l.c, l.size, l.stride);
+        run_bench_case(cfg, name, bench_im2col, &b, 0);
+        free(b.im); free(b.col);
+    }
+    nshapes = 0;
+    for(i = 0; i < net.n; ++i){
+        layer l = net.layers[i];
+        if(l.type != MAXPOOL) continue;
+        if(seen_shape(shapes, nshapes, l.w*l.h, l.c, l.size*8 + l.stride)) continue;
+        shapes[3*nshapes] = l.w*l.h; shapes[3*nshapes+1] = l.c; shapes[3*nshapes+2] = l.size*8 + l.stride;
+        ++nshapes;
+
+        layer_bench b = {0};
+        b.l = make_maxpool_layer(1, l.h, l.w, l.c, l.size, l.stride, l.pad, 0);
+        b.net.input = random_array(l.h*l.w*l.c);
+        sprintf(name, "maxpool %dx%dx%d k%d s%d", l.w, l.h, l.c, l.size, l.stride);
+        run_bench_case(cfg, name, bench_maxpool, &b, 0);
+        free(b.net.input);
+        free_layer(b.l);
+    }
+    free(shapes);
+}
+
+void bench_misc(bench_config cfg)
+{
+    char name[256];
+    int i;
+    ACTIVATION acts[] = {LEAKY, LOGISTIC, RELU, LINEAR};
+    activation_bench a = {0, 416*416*16};
+    float *x = random_array(a.n);
+    a.x = calloc(a.n, sizeof(float));
+    for(i = 0; i < sizeof(acts)/sizeof(acts[0]); ++i){
+        a.a = acts[i];
+        memcpy(a.x, x, a.n*sizeof(float));
+        sprintf(name, "activate %s %d", get_activation_string(a.a), a.n);
+        run_bench_case(cfg, name, bench_activation, &a, 0);
+    }
+    free(x);
+    free(a.x);
+
+    int sizes[][4] = {{640, 480, 416, 416}, {1280, 720, 416, 416}, {1920, 1080, 608, 608}};
+    for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i){
+        resize_bench r = {make_image(sizes[i][0], sizes[i][1], 3), sizes[i][2], sizes[i][3]};
+        int j;
+        for(j = 0; j < r.im.w*r.im.h*r.im.c; ++j) r.im.data[j] = rand_uniform(0, 1);
+        sprintf(name, "resize %dx%d->%dx%d", sizes[i][0], sizes[i][1], sizes[i][2], sizes[i][3]);
+        run_bench_case(cfg, name, bench_resize, &r, 0);
+        free_image(r.im);
+    }
+
+    int nms[][2] = {{845, 20}, {845, 80}, {4225, 80}};
+    for(i = 0; i < sizeof(nms)/sizeof(nms[0]); ++i){
+        nms_bench b = {0};
+        b.total = nms[i][0];
+        b.classes = nms[i][1];
+        b.boxes = calloc(b.total, sizeof(box));
+        b.probs = calloc(b.total, sizeof(float *));
+        b.orig = calloc(b.total*(b.classes+1), sizeof(float));
+        int j, k;
+        for(j = 0; j < b.total; ++j){
+            box bx = {rand_uniform(0, 1), rand_uniform(0, 1), rand_uniform(.02, .4), rand_uniform(.02, .4)};
+            b.boxes[j] = bx;
+            b.probs[j] = calloc(b.classes+1, sizeof(float));
+            for(k = 0; k < b.classes; ++k){
+                float p = rand_uniform(0, 1);
+                b.orig[j*(b.classes+1) + k] = p > .9 ? p : 0;
+            }
+        }
+        sprintf(name, "nms %d boxes %d classes", b.total, b.classes);
+        run_bench_case(cfg, name, bench_nms, &b, 0);
+        for(j = 0; j < b.total; ++j) free(b.probs[j]);
+        free(b.probs);
+        free(b.boxes);
+        free(b.orig);
+    }
+}
+
+void bench_network(bench_config cfg, network *net, char *cfgfile, int *batches, int nbatches)
+{
+    char name[256];
+    int i, j;
+    for(i = 0; i < nbatches; ++i){
+        int b = batches[i];
+        set_batch_network(net, b);
+        layer_bench f = {0};
+        f.net = *net;
+        f.net.input = calloc(net->inputs*b, sizeof(float));
+        for(j = 0; j < net->inputs*b; ++j) f.net.input[j] = rand_uniform(0, 1);
+        double flops = 0;
+        for(j = 0; j < net->n; ++j) flops += layer_flops(net->layers[j]);
+        sprintf(name, "forward %s b%d", basecfg(cfgfile), b);
+        run_bench_case(cfg, name, bench_forward, &f, flops);
+        free(f.net.input);
+    }
+}
+
+void run_bench(int argc, char **argv)
+{
+    bench_config cfg = {0};
+    cfg.reps = find_int_arg(argc, argv, "-reps", 20);
+    cfg.warmup = find_int_arg(argc, argv, "-warmup", 3);
+    cfg.budget = find_float_arg(argc, argv, "-budget", 2);
+    cfg.only = find_char_arg(argc, argv, "-only", 0);
+    char *outfile = find_char_arg(argc, argv, "-out", 0);
+    char *cfgs = find_char_arg(argc, argv, "-cfgs", "cfg/tiny-yolo-voc.cfg,cfg/yolo-voc.cfg");
+    char *batch_list = find_char_arg(argc, argv, "-batches", "1,2,4");
+    int nbatches = 0;
+    int *batches = read_intlist(batch_list, &nbatches, 1);
+    if(cfg.reps < 1) cfg.reps = 1;
+    if(outfile){
+        cfg.out = fopen(outfile, "w");
+        if(!cfg.out) file_error(outfile);
+    }
+    srand(2222222);
+
+    printf("%-40s %5s %10s %10s %10s %10s %10s %10s %9s\n", "benchmark", "runs", "min ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "mean ms", "GFLOP/s");
+    bench_misc(cfg);
+
+    char *list = copy_string(cfgs);
+    char *cfgfile = strtok(list, ",");
+    while(cfgfile){
+        network net = parse_network_cfg_custom(cfgfile, 0, 0);
+        bench_kernels(cfg, net);
+        bench_network(cfg, &net, cfgfile, batches, nbatches);
+        free_network(net);
+        cfgfile = strtok(0, ",");
+    }
+    free(list);
+    free(batches);
+    if(cfg.out) fclose(cfg.out);
+}
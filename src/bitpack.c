@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bitpack.h"
+#include "mapped_weights.h"
+#include "utils.h"
+
+int bitpack_words(int k)
+{
+    return (k + 63) / 64;
+}
+
+/* Packed patches with their padding masks, the valid bit count of every patch and the input signs. */
+size_t bitpack_workspace_size(layer l)
+{
+    size_t n = l.out_w*l.out_h;
+    return n*2*bitpack_words(l.size*l.size*l.c)*sizeof(uint64_t) + n*sizeof(int) + l.c*l.h*l.w;
+}
+
+static void drop_float_weights(network *net, layer *l)
+{
+    if(!is_mapped_pointer(net, l->weights)) free(l->weights);
+    free(l->binary_weights);
+    free(l->binary_input);
+    l->weights = l->binary_weights = l->binary_input = 0;
+    l->bitpacked = 1;
+}
+
+void enable_bitpacked_layer(network *net, layer *l)
+{
+    if(l->type != CONVOLUTIONAL || !l->xnor || l->groups > 1) error("Only dense xnor convolutional layers can be bit-packed");
+#ifdef GPU
+    if(gpu_index >= 0) error("Bit-packed weights are CPU only");
+#endif
+    drop_float_weights(net, l);
+}
+
+/* Same binarization as binarize_weights: sign bits plus the mean magnitude of each filter. */
+void pack_binary_weights(network *net, layer *l)
+{
+    int f, i;
+    int k = l->size*l->size*l->c;
+    int words = bitpack_words(k);
+    uint64_t *bits = calloc((size_t)l->n*words, sizeof(uint64_t));
+    float *scales = calloc(l->n, sizeof(float));
+    for(f = 0; f < l->n; ++f){
+        float *w = l->weights + (size_t)f*k;
+        float mean = 0;
+        for(i = 0; i < k; ++i) mean += fabs(w[i]);
+        scales[f] = mean / k;
+        for(i = 0; i < k; ++i){
+            if(w[i] > 0) bits[(size_t)f*words + i/64] |= 1ULL << (i%64);
+        }
+    }
+    enable_bitpacked_layer(net, l);
+    l->bit_weights = bits;
+    l->bit_scales = scales;
+}
+
+void pack_network_weights(network *net, int start, int cutoff)
+{
+    int i;
+#ifdef GPU
+    if(gpu_index >= 0) return;
+#endif
+    for(i = start; i < net->n && i < cutoff; ++i){
+        layer *l = net->layers + i;
+        if(l->type != CONVOLUTIONAL || !l->xnor || l->groups > 1 || l->bitpacked || l->weight_updates || l->dontload) continue;
+        pack_binary_weights(net, l);
+    }
+}
+
+/* Each patch row holds the sign bits followed by a mask of the taps that fall inside the image,
+   so zero padding contributes nothing exactly like the float path. */
+static void im2row_bits(unsigned char *signs, int c, int h, int w, int size, int stride, int pad,
+        int out_h, int out_w, int words, uint64_t *rows, int *valid)
+{
+    int x, y, ch, i, j;
+    for(y = 0; y < out_h; ++y){
+        for(x = 0; x < out_w; ++x){
+            int p = y*out_w + x;
+            uint64_t *bits = rows + (size_t)p*2*words;
+            uint64_t *mask = bits + words;
+            memset(bits, 0, 2*words*sizeof(uint64_t));
+            int k = 0;
+            int count = 0;
+            for(ch = 0; ch < c; ++ch){
+                for(i = 0; i < size; ++i){
+                    int iy = y*stride + i - pad;
+                    for(j = 0; j < size; ++j, ++k){
+                        int ix = x*stride + j - pad;
+                        if(iy < 0 || iy >= h || ix < 0 || ix >= w) continue;
+                        uint64_t bit = 1ULL << (k%64);
+                        mask[k/64] |= bit;
+                        if(signs[(ch*h + iy)*w + ix]) bits[k/64] |= bit;
+                        ++count;
+                    }
+                }
+            }
+            valid[p] = count;
+        }
+    }
+}
+
+/* c[f*n + p] = scale[f] * (valid[p] - 2*popcount((a[f] ^ b[p]) & mask[p])) */
+static void gemm_xnor(int m, int n, int words, uint64_t *a, uint64_t *b, int *valid, float *scales, float *c)
+{
+    int f, p, i, j;
+    for(f = 0; f < m; f += 4){
+        int nf = (m - f < 4) ? m - f : 4;
+        uint64_t *wf = a + (size_t)f*words;
+        for(p = 0; p < n; ++p){
+            uint64_t *bits = b + (size_t)p*2*words;
+            uint64_t *mask = bits + words;
+            int diff[4] = {0};
+            for(i = 0; i < words; ++i){
+                for(j = 0; j < nf; ++j){
+                    diff[j] += __builtin_popcountll((wf[j*words + i] ^ bits[i]) & mask[i]);
+                }
+            }
+            for(j = 0; j < nf; ++j){
+                c[(size_t)(f+j)*n + p] = scales[f+j]*(valid[p] - 2*diff[j]);
+            }
+        }
+    }
+}
+
+void forward_bitpacked_convolution(layer l, network net)
+{
+    int b, i;
+    int words = bitpack_words(l.size*l.size*l.c);
+    int n = l.out_w*l.out_h;
+    uint64_t *rows = (uint64_t *)net.workspace;
+    int *valid = (int *)(rows + (size_t)n*2*words);
+    unsigned char *signs = (unsigned char *)(valid + n);
+    for(b = 0; b < l.batch; ++b){
+        float *input = net.input + b*l.inputs;
+        for(i = 0; i < l.inputs; ++i) signs[i] = input[i] > 0;
+        im2row_bits(signs, l.c, l.h, l.w, l.size, l.stride, l.pad, l.out_h, l.out_w, words, rows, valid);
+        gemm_xnor(l.n, n, words, l.bit_weights, rows, valid, l.bit_scales, l.output + b*l.outputs);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef BITPACK_H
+#define BITPACK_H
+
+#include "network.h"
+
+int bitpack_words(int k);
+size_t bitpack_workspace_size(layer l);
+void enable_bitpacked_layer(network *net, layer *l);
+void pack_binary_weights(network *net, layer *l);
+void pack_network_weights(network *net, int start, int cutoff);
+void forward_bitpacked_convolution(layer l, network net);
+
+#endif
@@ -5,23 +5,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+/* Stride 2 pairs channels k and k + out_c into the even and odd columns of one wide row,
+   so every row is read and written contiguously. */
+static void reorg2_cpu(float *x, int w, int h, int c, int batch, int forward, float *out)
+{
+    int b,k,j,dy,i;
+    int out_c = c/4;
+    for(b = 0; b < batch; ++b){
+        for(k = 0; k < out_c; ++k){
+            for(j = 0; j < h; ++j){
+                for(dy = 0; dy < 2; ++dy){
+                    int even = k + out_c*2*dy;
+                    float *wide = (forward ? out : x) + 2*w*(j*2 + dy + 2*h*(k + out_c*b));
+                    float *s0 = (forward ? x : out) + w*(j + h*(even + c*b));
+                    float *s1 = s0 + w*h*out_c;
+                    if(forward){
+                        for(i = 0; i < w; ++i){
+                            wide[2*i] = s0[i];
+                            wide[2*i+1] = s1[i];
+                        }
+                    } else {
+                        for(i = 0; i < w; ++i){
+                            s0[i] = wide[2*i];
+                            s1[i] = wide[2*i+1];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 void reorg_cpu(float *x, int w, int h, int c, int batch, int stride, int forward, float *out)
 {
     int b,i,j,k;
     int out_c = c/(stride*stride);
 
+    if(stride == 2 && c % 4 == 0){
+        reorg2_cpu(x, w, h, c, batch, forward, out);
+        return;
+    }
     for(b = 0; b < batch; ++b){
         for(k = 0; k < c; ++k){
+            int c2 = k % out_c;
+            int offset = k / out_c;
             for(j = 0; j < h; ++j){
+                int in_index = w*(j + h*(k + c*b));
+                int out_index = offset % stride + w*stride*(j*stride + offset / stride + h*stride*(c2 + out_c*b));
                 for(i = 0; i < w; ++i){
-                    int in_index  = i + w*(j + h*(k + c*b));
-                    int c2 = k % out_c;
-                    int offset = k / out_c;
-                    int w2 = i*stride + offset % stride;
-                    int h2 = j*stride + offset / stride;
-                    int out_index = w2 + w*stride*(h2 + h*stride*(c2 + out_c*b));
-                    if(forward) out[out_index] = x[in_index];
-                    else out[in_index] = x[out_index];
+                    if(forward) out[out_index + i*stride] = x[in_index + i];
+                    else out[in_index + i] = x[out_index + i*stride];
                 }
             }
         }
@@ -67,6 +100,11 @@ void shortcut_cpu(int batch, int w1, int h1, int c1, float *add, int w2, int h2,
     int minc = (c1 < c2) ? c1 : c2;
 
     int i,j,k,b;
+    if(w1 == w2 && h1 == h2 && c1 == c2){
+        int n = batch*w1*h1*c1;
+        for(i = 0; i < n; ++i) out[i] += add[i];
+        return;
+    }
     for(b = 0; b < batch; ++b){
         for(k = 0; k < minc; ++k){
             for(j = 0; j < minh; ++j){
@@ -112,6 +150,31 @@ void variance_cpu(float *x, float *mean, int batch, int filters, int spatial, fl
     }
 }
 
+/* mean_cpu and variance_cpu in one walk over memory: each contiguous row is summed while it is
+   in cache and its statistics merged into the filter's running values (Chan et al.). */
+void mean_variance_cpu(float *x, int batch, int filters, int spatial, float *mean, float *variance)
+{
+    int b, f, i;
+    for(b = 0; b < batch; ++b){
+        for(f = 0; f < filters; ++f){
+            float *row = x + (b*filters + f)*spatial;
+            float sum = 0, m2 = 0;
+            for(i = 0; i < spatial; ++i) sum += row[i];
+            float row_mean = sum/spatial;
+            for(i = 0; i < spatial; ++i) m2 += (row[i] - row_mean)*(row[i] - row_mean);
+            if(b == 0){
+                mean[f] = row_mean;
+                variance[f] = m2;
+            } else {
+                float d = row_mean - mean[f];
+                mean[f] += d/(b + 1);
+                variance[f] += m2 + d*d*spatial*b/(b + 1);
+            }
+        }
+    }
+    for(f = 0; f < filters; ++f) variance[f] /= (batch*spatial - 1);
+}
+
 void normalize_cpu(float *x, float *mean, float *variance, int batch, int filters, int spatial)
 {
     int b, f, i;
@@ -23,6 +23,7 @@ void shortcut_cpu(int batch, int w1, int h1, int c1, float *add, int w2, int h2,
 
 void mean_cpu(float *x, int batch, int filters, int spatial, float *mean);
 void variance_cpu(float *x, float *mean, int batch, int filters, int spatial, float *variance);
+void mean_variance_cpu(float *x, int batch, int filters, int spatial, float *mean, float *variance);
 void normalize_cpu(float *x, float *mean, float *variance, int batch, int filters, int spatial);
 
 void scale_bias(float *output, float *scales, int batch, int n, int size);
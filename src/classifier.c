@@ -6,6 +6,8 @@
 #include "assert.h"
 #include "classifier.h"
 #include "cuda.h"
+#include "replica.h"
+#include "ring.h"
 #include <sys/time.h>
 
 float *get_regression_values(char **labels, int n)
@@ -20,7 +22,7 @@ float *get_regression_values(char **labels, int n)
     return v;
 }
 
-void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus, int ngpus, int clear)
+void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus, int ngpus, int clear, ring *r)
 {
     int i;
 
@@ -43,7 +45,11 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
         }
         if(clear) *nets[i].seen = 0;
         nets[i].learning_rate *= ngpus;
+        if(r) nets[i].learning_rate *= r->size;
     }
+#ifndef GPU
+    if(ngpus > 1) share_network_weights(nets, ngpus);
+#endif
     srand(time(0));
     network net = nets[0];
 
@@ -62,7 +68,9 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
     char **paths = (char **)list_to_array(plist);
     printf("%d\n", plist->size);
     int N = plist->size;
-    clock_t time;
+    int shard = N;
+    char **shard_paths = r ? ring_shard_paths(r, paths, &shard) : paths;
+    double time;
 
     load_args args = {0};
     args.w = net.w;
@@ -79,10 +87,10 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
     args.hue = net.hue;
     args.size = net.w;
 
-    args.paths = paths;
+    args.paths = shard_paths;
     args.classes = classes;
     args.n = imgs;
-    args.m = N;
+    args.m = shard;
     args.labels = labels;
     args.type = CLASSIFICATION_DATA;
 
@@ -93,15 +101,16 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
     load_thread = load_data(args);
 
     int epoch = (*net.seen)/N;
+    int steps = 0;
     while(get_current_batch(net) < net.max_batches || net.max_batches == 0){
-        time=clock();
+        time=get_wall_time();
 
         pthread_join(load_thread, 0);
         train = buffer;
         load_thread = load_data(args);
 
-        printf("Loaded: %lf seconds\n", sec(clock()-time));
-        time=clock();
+        printf("Loaded: %lf seconds\n", get_wall_time()-time);
+        time=get_wall_time();
 
         float loss = 0;
 #ifdef GPU
@@ -111,27 +120,46 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
             loss = train_networks(nets, ngpus, train, 4);
         }
 #else
-        loss = train_network(net, train);
+        if(ngpus == 1){
+            loss = train_network(net, train);
+        } else {
+            loss = train_network_replicas(nets, ngpus, train);
+        }
 #endif
+        if(r && ++steps == 4){
+            sync_ring(r, nets, ngpus, steps);
+            steps = 0;
+        }
         if(avg_loss == -1) avg_loss = loss;
         avg_loss = avg_loss*.9 + loss*.1;
-        printf("%d, %.3f: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), (float)(*net.seen)/N, loss, avg_loss, get_current_rate(net), sec(clock()-time), *net.seen);
+        printf("%d, %.3f: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), (float)(*net.seen)/N, loss, avg_loss, get_current_rate(net), get_wall_time()-time, *net.seen);
         free_data(train);
         if(*net.seen/N > epoch){
             epoch = *net.seen/N;
+            if(r){
+                sync_ring(r, nets, ngpus, steps);
+                steps = 0;
+            }
             char buff[256];
             sprintf(buff, "%s/%s_%d.weights",backup_directory,base, epoch);
-            save_weights(net, buff);
+            if(!r || !r->rank) save_weights(net, buff);
         }
         if(get_current_batch(net)%1000 == 0){
+            if(r){
+                sync_ring(r, nets, ngpus, steps);
+                steps = 0;
+            }
             char buff[256];
             sprintf(buff, "%s/%s.backup",backup_directory,base);
-            save_weights(net, buff);
+            if(!r || !r->rank) save_weights(net, buff);
         }
     }
+    if(r) sync_ring(r, nets, ngpus, steps);
     char buff[256];
     sprintf(buff, "%s/%s.weights", backup_directory, base);
-    save_weights(net, buff);
+    if(!r || !r->rank) save_weights(net, buff);
+    free_ring(r);
+    if(shard_paths != paths) free(shard_paths);
 
     free_network(net);
     free_ptrs((void**)labels, classes);
@@ -169,7 +197,7 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
    char **paths = (char **)list_to_array(plist);
    printf("%d\n", plist->size);
    int N = plist->size;
-   clock_t time;
+   double time;
 
    load_args args = {0};
    args.w = net.w;
@@ -201,14 +229,14 @@ void train_classifier(char *datacfg, char *cfgfile, char *weightfile, int *gpus,
 
    int epoch = (*net.seen)/N;
    while(get_current_batch(net) < net.max_batches || net.max_batches == 0){
-   time=clock();
+   time=get_wall_time();
 
    pthread_join(load_thread, 0);
    train = buffer;
    load_thread = load_data(args);
 
-   printf("Loaded: %lf seconds\n", sec(clock()-time));
-   time=clock();
+   printf("Loaded: %lf seconds\n", get_wall_time()-time);
+   time=get_wall_time();
 
 #ifdef OPENCV
 if(0){
@@ -226,7 +254,7 @@ free_data(train);
 
 if(avg_loss == -1) avg_loss = loss;
 avg_loss = avg_loss*.9 + loss*.1;
-printf("%d, %.3f: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), (float)(*net.seen)/N, loss, avg_loss, get_current_rate(net), sec(clock()-time), *net.seen);
+printf("%d, %.3f: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), (float)(*net.seen)/N, loss, avg_loss, get_current_rate(net), get_wall_time()-time, *net.seen);
 if(*net.seen/N > epoch){
     epoch = *net.seen/N;
     char buff[256];
@@ -274,7 +302,7 @@ void validate_classifier_crop(char *datacfg, char *filename, char *weightfile)
     int m = plist->size;
     free_list(plist);
 
-    clock_t time;
+    double time;
     float avg_acc = 0;
     float avg_topk = 0;
     int splits = m/1000;
@@ -296,7 +324,7 @@ void validate_classifier_crop(char *datacfg, char *filename, char *weightfile)
 
     pthread_t load_thread = load_data_in_thread(args);
     for(i = 1; i <= splits; ++i){
-        time=clock();
+        time=get_wall_time();
 
         pthread_join(load_thread, 0);
         val = buffer;
@@ -307,13 +335,13 @@ void validate_classifier_crop(char *datacfg, char *filename, char *weightfile)
             args.paths = part;
             load_thread = load_data_in_thread(args);
         }
-        printf("Loaded: %d images in %lf seconds\n", val.X.rows, sec(clock()-time));
+        printf("Loaded: %d images in %lf seconds\n", val.X.rows, get_wall_time()-time);
 
-        time=clock();
+        time=get_wall_time();
         float *acc = network_accuracies(net, val, topk);
         avg_acc += acc[0];
         avg_topk += acc[1];
-        printf("%d: top 1: %f, top %d: %f, %lf seconds, %d images\n", i, avg_acc/i, topk, avg_topk/i, sec(clock()-time), val.X.rows);
+        printf("%d: top 1: %f, top %d: %f, %lf seconds, %d images\n", i, avg_acc/i, topk, avg_topk/i, get_wall_time()-time, val.X.rows);
         free_data(val);
     }
 }
@@ -594,7 +622,7 @@ void try_classifier(char *datacfg, char *cfgfile, char *weightfile, char *filena
 
     int i = 0;
     char **names = get_labels(name_list);
-    clock_t time;
+    double time;
     int *indexes = calloc(top, sizeof(int));
     char buff[256];
     char *input = buff;
@@ -621,7 +649,7 @@ void try_classifier(char *datacfg, char *cfgfile, char *weightfile, char *filena
         normalize_cpu(im.data, mean, var, 1, 3, im.w*im.h);
 
         float *X = im.data;
-        time=clock();
+        time=get_wall_time();
         float *predictions = network_predict(net, X);
 
         layer l = net.layers[layer_num];
@@ -648,7 +676,7 @@ void try_classifier(char *datacfg, char *cfgfile, char *weightfile, char *filena
          */
 
         top_predictions(net, top, indexes);
-        printf("%s: Predicted in %f seconds.\n", input, sec(clock()-time));
+        printf("%s: Predicted in %f seconds.\n", input, get_wall_time()-time);
         for(i = 0; i < top; ++i){
             int index = indexes[i];
             printf("%s: %f\n", names[index], predictions[index]);
@@ -675,7 +703,7 @@ void predict_classifier(char *datacfg, char *cfgfile, char *weightfile, char *fi
 
     int i = 0;
     char **names = get_labels(name_list);
-    clock_t time;
+    double time;
     int *indexes = calloc(top, sizeof(int));
     char buff[256];
     char *input = buff;
@@ -696,11 +724,11 @@ void predict_classifier(char *datacfg, char *cfgfile, char *weightfile, char *fi
         //printf("%d %d\n", r.w, r.h);
 
         float *X = r.data;
-        time=clock();
+        time=get_wall_time();
         float *predictions = network_predict(net, X);
         if(net.hierarchy) hierarchy_predictions(predictions, net.outputs, net.hierarchy, 1, 1);
         top_k(predictions, net.outputs, top, indexes);
-        printf("%s: Predicted in %f seconds.\n", input, sec(clock()-time));
+        printf("%s: Predicted in %f seconds.\n", input, get_wall_time()-time);
         for(i = 0; i < top; ++i){
             int index = indexes[i];
             //if(net.hierarchy) printf("%d, %s: %f, parent: %s \n",index, names[index], predictions[index], (net.hierarchy->parent[index] >= 0) ? names[net.hierarchy->parent[index]] : "Root");
@@ -773,7 +801,7 @@ void test_classifier(char *datacfg, char *cfgfile, char *weightfile, int target_
     int m = plist->size;
     free_list(plist);
 
-    clock_t time;
+    double time;
 
     data val, buffer;
 
@@ -790,7 +818,7 @@ void test_classifier(char *datacfg, char *cfgfile, char *weightfile, int target_
 
     pthread_t load_thread = load_data_in_thread(args);
     for(curr = net.batch; curr < m; curr += net.batch){
-        time=clock();
+        time=get_wall_time();
 
         pthread_join(load_thread, 0);
         val = buffer;
@@ -800,9 +828,9 @@ void test_classifier(char *datacfg, char *cfgfile, char *weightfile, int target_
             if (curr + net.batch > m) args.n = m - curr;
             load_thread = load_data_in_thread(args);
         }
-        fprintf(stderr, "Loaded: %d images in %lf seconds\n", val.X.rows, sec(clock()-time));
+        fprintf(stderr, "Loaded: %d images in %lf seconds\n", val.X.rows, get_wall_time()-time);
 
-        time=clock();
+        time=get_wall_time();
         matrix pred = network_predict_data(net, val);
 
         int i, j;
@@ -820,7 +848,7 @@ void test_classifier(char *datacfg, char *cfgfile, char *weightfile, int target_
 
         free_matrix(pred);
 
-        fprintf(stderr, "%lf seconds, %d images, %d total\n", sec(clock()-time), val.X.rows, curr);
+        fprintf(stderr, "%lf seconds, %d images, %d total\n", get_wall_time()-time, val.X.rows, curr);
         free_data(val);
     }
 }
@@ -1116,6 +1144,12 @@ void run_classifier(int argc, char **argv)
     char *gpu_list = find_char_arg(argc, argv, "-gpus", 0);
     int ngpus;
     int *gpus = read_intlist(gpu_list, &ngpus, gpu_index);
+#ifndef GPU
+    int threads = find_int_arg(argc, argv, "-threads", 0);
+    if(threads > 1) ngpus = threads;
+#endif
+    char *ring_peers = find_char_arg(argc, argv, "-ring", 0);
+    int rank = find_int_arg(argc, argv, "-rank", 0);
 
 
     int cam_index = find_int_arg(argc, argv, "-c", 0);
@@ -1129,7 +1163,7 @@ void run_classifier(int argc, char **argv)
     int layer = layer_s ? atoi(layer_s) : -1;
     if(0==strcmp(argv[2], "predict")) predict_classifier(data, cfg, weights, filename, top);
     else if(0==strcmp(argv[2], "try")) try_classifier(data, cfg, weights, filename, atoi(layer_s));
-    else if(0==strcmp(argv[2], "train")) train_classifier(data, cfg, weights, gpus, ngpus, clear);
+    else if(0==strcmp(argv[2], "train")) train_classifier(data, cfg, weights, gpus, ngpus, clear, ring_peers ? make_ring(ring_peers, rank) : 0);
     else if(0==strcmp(argv[2], "demo")) demo_classifier(data, cfg, weights, cam_index, filename);
     else if(0==strcmp(argv[2], "gun")) gun_classifier(data, cfg, weights, cam_index, filename);
     else if(0==strcmp(argv[2], "threat")) threat_classifier(data, cfg, weights, cam_index, filename);
@@ -4,13 +4,15 @@
 #include "cuda.h"
 #include "blas.h"
 #include "gemm.h"
+#include "quantize.h"
+#include "half.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVATION activation, int batch_normalize)
+connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVATION activation, int batch_normalize, int train)
 {
     int i;
     connected_layer l = {0};
@@ -28,10 +30,12 @@ connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVAT
     l.out_c = outputs;
 
     l.output = calloc(batch*outputs, sizeof(float));
-    l.delta = calloc(batch*outputs, sizeof(float));
+    if(train){
+        l.delta = calloc(batch*outputs, sizeof(float));
 
-    l.weight_updates = calloc(inputs*outputs, sizeof(float));
-    l.bias_updates = calloc(outputs, sizeof(float));
+        l.weight_updates = calloc(inputs*outputs, sizeof(float));
+        l.bias_updates = calloc(outputs, sizeof(float));
+    }
 
     l.weights = calloc(outputs*inputs, sizeof(float));
     l.biases = calloc(outputs, sizeof(float));
@@ -52,21 +56,24 @@ connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVAT
 
     if(batch_normalize){
         l.scales = calloc(outputs, sizeof(float));
-        l.scale_updates = calloc(outputs, sizeof(float));
         for(i = 0; i < outputs; ++i){
             l.scales[i] = 1;
         }
 
-        l.mean = calloc(outputs, sizeof(float));
-        l.mean_delta = calloc(outputs, sizeof(float));
-        l.variance = calloc(outputs, sizeof(float));
-        l.variance_delta = calloc(outputs, sizeof(float));
-
         l.rolling_mean = calloc(outputs, sizeof(float));
         l.rolling_variance = calloc(outputs, sizeof(float));
 
-        l.x = calloc(batch*outputs, sizeof(float));
-        l.x_norm = calloc(batch*outputs, sizeof(float));
+        if(train){
+            l.scale_updates = calloc(outputs, sizeof(float));
+
+            l.mean = calloc(outputs, sizeof(float));
+            l.mean_delta = calloc(outputs, sizeof(float));
+            l.variance = calloc(outputs, sizeof(float));
+            l.variance_delta = calloc(outputs, sizeof(float));
+
+            l.x = calloc(batch*outputs, sizeof(float));
+            l.x_norm = calloc(batch*outputs, sizeof(float));
+        }
     }
 
 #ifdef GPU
@@ -77,26 +84,31 @@ connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVAT
     l.weights_gpu = cuda_make_array(l.weights, outputs*inputs);
     l.biases_gpu = cuda_make_array(l.biases, outputs);
 
-    l.weight_updates_gpu = cuda_make_array(l.weight_updates, outputs*inputs);
-    l.bias_updates_gpu = cuda_make_array(l.bias_updates, outputs);
-
     l.output_gpu = cuda_make_array(l.output, outputs*batch);
-    l.delta_gpu = cuda_make_array(l.delta, outputs*batch);
+    if(train){
+        l.weight_updates_gpu = cuda_make_array(l.weight_updates, outputs*inputs);
+        l.bias_updates_gpu = cuda_make_array(l.bias_updates, outputs);
+
+        l.delta_gpu = cuda_make_array(l.delta, outputs*batch);
+    }
     if(batch_normalize){
         l.scales_gpu = cuda_make_array(l.scales, outputs);
-        l.scale_updates_gpu = cuda_make_array(l.scale_updates, outputs);
 
-        l.mean_gpu = cuda_make_array(l.mean, outputs);
-        l.variance_gpu = cuda_make_array(l.variance, outputs);
+        l.rolling_mean_gpu = cuda_make_array(l.rolling_mean, outputs);
+        l.rolling_variance_gpu = cuda_make_array(l.rolling_variance, outputs);
+
+        if(train){
+            l.scale_updates_gpu = cuda_make_array(l.scale_updates, outputs);
 
-        l.rolling_mean_gpu = cuda_make_array(l.mean, outputs);
-        l.rolling_variance_gpu = cuda_make_array(l.variance, outputs);
+            l.mean_gpu = cuda_make_array(l.mean, outputs);
+            l.variance_gpu = cuda_make_array(l.variance, outputs);
 
-        l.mean_delta_gpu = cuda_make_array(l.mean, outputs);
-        l.variance_delta_gpu = cuda_make_array(l.variance, outputs);
+            l.mean_delta_gpu = cuda_make_array(l.mean, outputs);
+            l.variance_delta_gpu = cuda_make_array(l.variance, outputs);
 
-        l.x_gpu = cuda_make_array(l.output, l.batch*outputs);
-        l.x_norm_gpu = cuda_make_array(l.output, l.batch*outputs);
+            l.x_gpu = cuda_make_array(l.output, l.batch*outputs);
+            l.x_norm_gpu = cuda_make_array(l.output, l.batch*outputs);
+        }
 #ifdef CUDNN
         cudnnCreateTensorDescriptor(&l.normTensorDesc);
         cudnnCreateTensorDescriptor(&l.dstTensorDesc);
@@ -110,6 +122,37 @@ connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVAT
     return l;
 }
 
+void resize_connected_layer(connected_layer *l, int inputs)
+{
+    if(inputs != l->inputs) error("Connected layer inputs cannot change size");
+    if(l->quantized) l->workspace_size = quantized_workspace_size(*l);
+    l->output = realloc(l->output, l->batch*l->outputs*sizeof(float));
+    if(l->delta) l->delta = realloc(l->delta, l->batch*l->outputs*sizeof(float));
+    if(l->x){
+        l->x = realloc(l->x, l->batch*l->outputs*sizeof(float));
+        l->x_norm = realloc(l->x_norm, l->batch*l->outputs*sizeof(float));
+    }
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    l->output_gpu = cuda_make_array(l->output, l->batch*l->outputs);
+    if(l->delta_gpu){
+        cuda_free(l->delta_gpu);
+        l->delta_gpu = cuda_make_array(l->delta, l->batch*l->outputs);
+    }
+    if(l->x_gpu){
+        cuda_free(l->x_gpu);
+        cuda_free(l->x_norm_gpu);
+        l->x_gpu = cuda_make_array(l->output, l->batch*l->outputs);
+        l->x_norm_gpu = cuda_make_array(l->output, l->batch*l->outputs);
+    }
+#ifdef CUDNN
+    if(l->batch_normalize){
+        cudnnSetTensor4dDescriptor(l->dstTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l->batch, l->out_c, l->out_h, l->out_w); 
+    }
+#endif
+#endif
+}
+
 void update_connected_layer(connected_layer l, int batch, float learning_rate, float momentum, float decay)
 {
     axpy_cpu(l.outputs, learning_rate/batch, l.bias_updates, 1, l.biases, 1);
@@ -128,6 +171,10 @@ void update_connected_layer(connected_layer l, int batch, float learning_rate, f
 void forward_connected_layer(connected_layer l, network net)
 {
     int i;
+    if(l.quantized){
+        forward_quantized_layer(l, net);
+        return;
+    }
     fill_cpu(l.outputs*l.batch, 0, l.output, 1);
     int m = l.batch;
     int k = l.inputs;
@@ -135,7 +182,8 @@ void forward_connected_layer(connected_layer l, network net)
     float *a = net.input;
     float *b = l.weights;
     float *c = l.output;
-    gemm(0,1,m,n,k,1,a,k,b,k,1,c,n);
+    if(l.half) gemm_half_nt(m,n,k,a,l.half_weights,l.half,c,net.workspace);
+    else gemm(0,1,m,n,k,1,a,k,b,k,1,c,n);
     if(l.batch_normalize){
         if(net.train){
             mean_cpu(l.output, l.batch, l.outputs, 1, l.mean);
@@ -237,8 +285,10 @@ void pull_connected_layer(connected_layer l)
 {
     cuda_pull_array(l.weights_gpu, l.weights, l.inputs*l.outputs);
     cuda_pull_array(l.biases_gpu, l.biases, l.outputs);
-    cuda_pull_array(l.weight_updates_gpu, l.weight_updates, l.inputs*l.outputs);
-    cuda_pull_array(l.bias_updates_gpu, l.bias_updates, l.outputs);
+    if(l.weight_updates){
+        cuda_pull_array(l.weight_updates_gpu, l.weight_updates, l.inputs*l.outputs);
+        cuda_pull_array(l.bias_updates_gpu, l.bias_updates, l.outputs);
+    }
     if (l.batch_normalize){
         cuda_pull_array(l.scales_gpu, l.scales, l.outputs);
         cuda_pull_array(l.rolling_mean_gpu, l.rolling_mean, l.outputs);
@@ -250,8 +300,10 @@ void push_connected_layer(connected_layer l)
 {
     cuda_push_array(l.weights_gpu, l.weights, l.inputs*l.outputs);
     cuda_push_array(l.biases_gpu, l.biases, l.outputs);
-    cuda_push_array(l.weight_updates_gpu, l.weight_updates, l.inputs*l.outputs);
-    cuda_push_array(l.bias_updates_gpu, l.bias_updates, l.outputs);
+    if(l.weight_updates){
+        cuda_push_array(l.weight_updates_gpu, l.weight_updates, l.inputs*l.outputs);
+        cuda_push_array(l.bias_updates_gpu, l.bias_updates, l.outputs);
+    }
     if (l.batch_normalize){
         cuda_push_array(l.scales_gpu, l.scales, l.outputs);
         cuda_push_array(l.rolling_mean_gpu, l.rolling_mean, l.outputs);
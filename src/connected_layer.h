@@ -7,11 +7,12 @@
 
 typedef layer connected_layer;
 
-connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVATION activation, int batch_normalize);
+connected_layer make_connected_layer(int batch, int inputs, int outputs, ACTIVATION activation, int batch_normalize, int train);
 
 void forward_connected_layer(connected_layer layer, network net);
 void backward_connected_layer(connected_layer layer, network net);
 void update_connected_layer(connected_layer layer, int batch, float learning_rate, float momentum, float decay);
+void resize_connected_layer(connected_layer *l, int inputs);
 void denormalize_connected_layer(layer l);
 void statistics_connected_layer(layer l);
 
@@ -74,12 +74,12 @@ void forward_convolutional_layer_gpu(convolutional_layer l, network net)
 {
     fill_ongpu(l.outputs*l.batch, 0, l.output_gpu, 1);
     if(l.binary){
-        binarize_weights_gpu(l.weights_gpu, l.n, l.c*l.size*l.size, l.binary_weights_gpu);
+        binarize_weights_gpu(l.weights_gpu, l.n, l.nweights/l.n, l.binary_weights_gpu);
         swap_binary(&l);
     }
 
     if(l.xnor){
-        binarize_weights_gpu(l.weights_gpu, l.n, l.c*l.size*l.size, l.binary_weights_gpu);
+        binarize_weights_gpu(l.weights_gpu, l.n, l.nweights/l.n, l.binary_weights_gpu);
         swap_binary(&l);
         binarize_gpu(net.input_gpu, l.c*l.h*l.w*l.batch, l.binary_input_gpu);
         net.input_gpu = l.binary_input_gpu;
@@ -102,16 +102,18 @@ void forward_convolutional_layer_gpu(convolutional_layer l, network net)
                 l.output_gpu);
 
 #else
-    int i;
-    int m = l.n;
-    int k = l.size*l.size*l.c;
+    int i, j;
+    int m = l.n/l.groups;
+    int k = l.size*l.size*l.c/l.groups;
     int n = l.out_w*l.out_h;
     for(i = 0; i < l.batch; ++i){
-        im2col_ongpu(net.input_gpu + i*l.c*l.h*l.w, l.c,  l.h,  l.w,  l.size,  l.stride, l.pad, net.workspace);
-        float * a = l.weights_gpu;
-        float * b = net.workspace;
-        float * c = l.output_gpu;
-        gemm_ongpu(0,0,m,n,k,1.,a,k,b,n,1.,c+i*m*n,n);
+        for(j = 0; j < l.groups; ++j){
+            im2col_ongpu(net.input_gpu + (i*l.groups + j)*l.c/l.groups*l.h*l.w, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, net.workspace);
+            float * a = l.weights_gpu + j*l.nweights/l.groups;
+            float * b = net.workspace;
+            float * c = l.output_gpu + (i*l.groups + j)*n*m;
+            gemm_ongpu(0,0,m,n,k,1.,a,k,b,n,1.,c,n);
+        }
     }
 #endif
 
@@ -221,68 +223,75 @@ void backward_convolutional_layer_gpu(convolutional_layer l, network net)
     }
 
 #else
-    int m = l.n;
-    int n = l.size*l.size*l.c;
+    int m = l.n/l.groups;
+    int n = l.size*l.size*l.c/l.groups;
     int k = l.out_w*l.out_h;
 
-    int i;
+    int i, j;
     for(i = 0; i < l.batch; ++i){
-        float * a = l.delta_gpu;
-        float * b = net.workspace;
-        float * c = l.weight_updates_gpu;
-
-        im2col_ongpu(net.input_gpu + i*l.c*l.h*l.w, l.c,  l.h,  l.w,  l.size,  l.stride, l.pad, net.workspace);
-        gemm_ongpu(0,1,m,n,k,1,a + i*m*k,k,b,k,1,c,n);
-
-        if(net.delta_gpu){
-            if(l.binary || l.xnor) swap_binary(&l);
-            float * a = l.weights_gpu;
-            float * b = l.delta_gpu;
-            float * c = net.workspace;
-
-            gemm_ongpu(1,0,n,k,m,1,a,n,b + i*k*m,k,0,c,k);
-
-            col2im_ongpu(net.workspace, l.c,  l.h,  l.w,  l.size,  l.stride, l.pad, net.delta_gpu + i*l.c*l.h*l.w);
-            if(l.binary || l.xnor) {
-                swap_binary(&l);
+        for(j = 0; j < l.groups; ++j){
+            float * a = l.delta_gpu + (i*l.groups + j)*m*k;
+            float * b = net.workspace;
+            float * c = l.weight_updates_gpu + j*l.nweights/l.groups;
+            int offset = (i*l.groups + j)*l.c/l.groups*l.h*l.w;
+
+            im2col_ongpu(net.input_gpu + offset, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, net.workspace);
+            gemm_ongpu(0,1,m,n,k,1,a,k,b,k,1,c,n);
+
+            if(net.delta_gpu){
+                if(l.binary || l.xnor) swap_binary(&l);
+                float * a = l.weights_gpu + j*l.nweights/l.groups;
+                float * b = l.delta_gpu + (i*l.groups + j)*m*k;
+                float * c = net.workspace;
+
+                gemm_ongpu(1,0,n,k,m,1,a,n,b,k,0,c,k);
+
+                col2im_ongpu(net.workspace, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, net.delta_gpu + offset);
+                if(l.binary || l.xnor) {
+                    swap_binary(&l);
+                }
             }
-            if(l.xnor) gradient_array_ongpu(original_input + i*l.c*l.h*l.w, l.c*l.h*l.w, HARDTAN, net.delta_gpu + i*l.c*l.h*l.w);
         }
+        if(net.delta_gpu && l.xnor) gradient_array_ongpu(original_input + i*l.c*l.h*l.w, l.c*l.h*l.w, HARDTAN, net.delta_gpu + i*l.c*l.h*l.w);
     }
 #endif
 }
 
 void pull_convolutional_layer(convolutional_layer layer)
 {
-    cuda_pull_array(layer.weights_gpu, layer.weights, layer.c*layer.n*layer.size*layer.size);
+    cuda_pull_array(layer.weights_gpu, layer.weights, layer.nweights);
     cuda_pull_array(layer.biases_gpu, layer.biases, layer.n);
-    cuda_pull_array(layer.weight_updates_gpu, layer.weight_updates, layer.c*layer.n*layer.size*layer.size);
-    cuda_pull_array(layer.bias_updates_gpu, layer.bias_updates, layer.n);
+    if(layer.weight_updates){
+        cuda_pull_array(layer.weight_updates_gpu, layer.weight_updates, layer.nweights);
+        cuda_pull_array(layer.bias_updates_gpu, layer.bias_updates, layer.n);
+    }
     if (layer.batch_normalize){
         cuda_pull_array(layer.scales_gpu, layer.scales, layer.n);
         cuda_pull_array(layer.rolling_mean_gpu, layer.rolling_mean, layer.n);
         cuda_pull_array(layer.rolling_variance_gpu, layer.rolling_variance, layer.n);
     }
-    if (layer.adam){
-        cuda_pull_array(layer.m_gpu, layer.m, layer.c*layer.n*layer.size*layer.size);
-        cuda_pull_array(layer.v_gpu, layer.v, layer.c*layer.n*layer.size*layer.size);
+    if (layer.m){
+        cuda_pull_array(layer.m_gpu, layer.m, layer.nweights);
+        cuda_pull_array(layer.v_gpu, layer.v, layer.nweights);
     }
 }
 
 void push_convolutional_layer(convolutional_layer layer)
 {
-    cuda_push_array(layer.weights_gpu, layer.weights, layer.c*layer.n*layer.size*layer.size);
+    cuda_push_array(layer.weights_gpu, layer.weights, layer.nweights);
     cuda_push_array(layer.biases_gpu, layer.biases, layer.n);
-    cuda_push_array(layer.weight_updates_gpu, layer.weight_updates, layer.c*layer.n*layer.size*layer.size);
-    cuda_push_array(layer.bias_updates_gpu, layer.bias_updates, layer.n);
+    if(layer.weight_updates){
+        cuda_push_array(layer.weight_updates_gpu, layer.weight_updates, layer.nweights);
+        cuda_push_array(layer.bias_updates_gpu, layer.bias_updates, layer.n);
+    }
     if (layer.batch_normalize){
         cuda_push_array(layer.scales_gpu, layer.scales, layer.n);
         cuda_push_array(layer.rolling_mean_gpu, layer.rolling_mean, layer.n);
         cuda_push_array(layer.rolling_variance_gpu, layer.rolling_variance, layer.n);
     }
-    if (layer.adam){
-        cuda_push_array(layer.m_gpu, layer.m, layer.c*layer.n*layer.size*layer.size);
-        cuda_push_array(layer.v_gpu, layer.v, layer.c*layer.n*layer.size*layer.size);
+    if (layer.m){
+        cuda_push_array(layer.m_gpu, layer.m, layer.nweights);
+        cuda_push_array(layer.v_gpu, layer.v, layer.nweights);
     }
 }
 
@@ -302,7 +311,7 @@ void adam_update_gpu(float *w, float *d, float *m, float *v, float B1, float B2,
 
 void update_convolutional_layer_gpu(layer l, int batch, float learning_rate, float momentum, float decay)
 {
-    int size = l.size*l.size*l.c*l.n;
+    int size = l.nweights;
 
     if(l.adam){
         adam_update_gpu(l.weights_gpu, l.weight_updates_gpu, l.m_gpu, l.v_gpu, l.B1, l.B2, l.eps, decay, learning_rate, size, batch, l.t);
@@ -5,6 +5,10 @@
 #include "col2im.h"
 #include "blas.h"
 #include "gemm.h"
+#include "quantize.h"
+#include "bitpack.h"
+#include "half.h"
+#include "winograd.h"
 #include <stdio.h>
 #include <time.h>
 
@@ -115,7 +119,12 @@ static size_t get_workspace_size(layer l){
         return most;
     }
 #endif
-    return (size_t)l.out_h*l.out_w*l.size*l.size*l.c*sizeof(float);
+    size_t s = (size_t)l.out_h*l.out_w*l.size*l.size*l.c/l.groups*sizeof(float);
+    if(l.quantized && quantized_workspace_size(l) > s) s = quantized_workspace_size(l);
+    if(l.xnor && bitpack_workspace_size(l) > s) s = bitpack_workspace_size(l);
+    if(l.half && half_workspace_size(l) > s) s = half_workspace_size(l);
+    if(l.winograd && winograd_workspace_size(l) > s) s = winograd_workspace_size(l);
+    return s;
 }
 
 #ifdef GPU
@@ -124,13 +133,18 @@ void cudnn_convolutional_setup(layer *l)
 {
     cudnnSetTensor4dDescriptor(l->dsrcTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l->batch, l->c, l->h, l->w);
     cudnnSetTensor4dDescriptor(l->ddstTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l->batch, l->out_c, l->out_h, l->out_w);
-    cudnnSetFilter4dDescriptor(l->dweightDesc, CUDNN_DATA_FLOAT, CUDNN_TENSOR_NCHW, l->n, l->c, l->size, l->size);
+    cudnnSetFilter4dDescriptor(l->dweightDesc, CUDNN_DATA_FLOAT, CUDNN_TENSOR_NCHW, l->n, l->c/l->groups, l->size, l->size);
 
     cudnnSetTensor4dDescriptor(l->srcTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l->batch, l->c, l->h, l->w);
     cudnnSetTensor4dDescriptor(l->dstTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l->batch, l->out_c, l->out_h, l->out_w);
     cudnnSetTensor4dDescriptor(l->normTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, 1, l->out_c, 1, 1);
-    cudnnSetFilter4dDescriptor(l->weightDesc, CUDNN_DATA_FLOAT, CUDNN_TENSOR_NCHW, l->n, l->c, l->size, l->size);
+    cudnnSetFilter4dDescriptor(l->weightDesc, CUDNN_DATA_FLOAT, CUDNN_TENSOR_NCHW, l->n, l->c/l->groups, l->size, l->size);
     cudnnSetConvolution2dDescriptor(l->convDesc, l->pad, l->pad, l->stride, l->stride, 1, 1, CUDNN_CROSS_CORRELATION);
+#if CUDNN_MAJOR >= 7
+    cudnnSetConvolutionGroupCount(l->convDesc, l->groups);
+#else
+    if(l->groups > 1) error("cuDNN 7 or newer is needed for grouped convolutions");
+#endif
     cudnnGetConvolutionForwardAlgorithm(cudnn_handle(),
             l->srcTensorDesc,
             l->weightDesc,
@@ -159,7 +173,7 @@ void cudnn_convolutional_setup(layer *l)
 #endif
 #endif
 
-convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam)
+convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int groups, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam, int train)
 {
     int i;
     convolutional_layer l = {0};
@@ -169,6 +183,7 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.w = w;
     l.c = c;
     l.n = n;
+    l.groups = groups;
     l.binary = binary;
     l.xnor = xnor;
     l.batch = batch;
@@ -177,20 +192,21 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.pad = padding;
     l.batch_normalize = batch_normalize;
 
-    l.weights = calloc(c*n*size*size, sizeof(float));
-    l.weight_updates = calloc(c*n*size*size, sizeof(float));
+    l.nweights = c/groups*n*size*size;
+    l.nbiases = n;
 
+    l.weights = calloc(l.nweights, sizeof(float));
     l.biases = calloc(n, sizeof(float));
-    l.bias_updates = calloc(n, sizeof(float));
-
-    l.nweights = c*n*size*size;
-    l.nbiases = n;
+    if(train){
+        l.weight_updates = calloc(l.nweights, sizeof(float));
+        l.bias_updates = calloc(n, sizeof(float));
+    }
 
     // float scale = 1./sqrt(size*size*c);
-    float scale = sqrt(2./(size*size*c));
+    float scale = sqrt(2./(size*size*c/groups));
     //scale = .02;
-    //for(i = 0; i < c*n*size*size; ++i) l.weights[i] = scale*rand_uniform(-1, 1);
-    for(i = 0; i < c*n*size*size; ++i) l.weights[i] = scale*rand_normal();
+    //for(i = 0; i < l.nweights; ++i) l.weights[i] = scale*rand_uniform(-1, 1);
+    for(i = 0; i < l.nweights; ++i) l.weights[i] = scale*rand_normal();
     int out_w = convolutional_out_width(l);
     int out_h = convolutional_out_height(l);
     l.out_h = out_h;
@@ -200,43 +216,47 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.inputs = l.w * l.h * l.c;
 
     l.output = calloc(l.batch*l.outputs, sizeof(float));
-    l.delta  = calloc(l.batch*l.outputs, sizeof(float));
+    if(train) l.delta  = calloc(l.batch*l.outputs, sizeof(float));
 
     l.forward = forward_convolutional_layer;
     l.backward = backward_convolutional_layer;
     l.update = update_convolutional_layer;
     if(binary){
-        l.binary_weights = calloc(c*n*size*size, sizeof(float));
-        l.cweights = calloc(c*n*size*size, sizeof(char));
+        l.binary_weights = calloc(l.nweights, sizeof(float));
+        l.cweights = calloc(l.nweights, sizeof(char));
         l.scales = calloc(n, sizeof(float));
     }
     if(xnor){
-        l.binary_weights = calloc(c*n*size*size, sizeof(float));
+        l.binary_weights = calloc(l.nweights, sizeof(float));
         l.binary_input = calloc(l.inputs*l.batch, sizeof(float));
     }
 
     if(batch_normalize){
         l.scales = calloc(n, sizeof(float));
-        l.scale_updates = calloc(n, sizeof(float));
         for(i = 0; i < n; ++i){
             l.scales[i] = 1;
         }
 
-        l.mean = calloc(n, sizeof(float));
-        l.variance = calloc(n, sizeof(float));
-
-        l.mean_delta = calloc(n, sizeof(float));
-        l.variance_delta = calloc(n, sizeof(float));
-
         l.rolling_mean = calloc(n, sizeof(float));
         l.rolling_variance = calloc(n, sizeof(float));
-        l.x = calloc(l.batch*l.outputs, sizeof(float));
-        l.x_norm = calloc(l.batch*l.outputs, sizeof(float));
+
+        if(train){
+            l.scale_updates = calloc(n, sizeof(float));
+
+            l.mean = calloc(n, sizeof(float));
+            l.variance = calloc(n, sizeof(float));
+
+            l.mean_delta = calloc(n, sizeof(float));
+            l.variance_delta = calloc(n, sizeof(float));
+
+            l.x = calloc(l.batch*l.outputs, sizeof(float));
+            l.x_norm = calloc(l.batch*l.outputs, sizeof(float));
+        }
     }
-    if(adam){
+    if(adam && train){
         l.adam = 1;
-        l.m = calloc(c*n*size*size, sizeof(float));
-        l.v = calloc(c*n*size*size, sizeof(float));
+        l.m = calloc(l.nweights, sizeof(float));
+        l.v = calloc(l.nweights, sizeof(float));
         l.bias_m = calloc(n, sizeof(float));
         l.scale_m = calloc(n, sizeof(float));
         l.bias_v = calloc(n, sizeof(float));
@@ -249,47 +269,51 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.update_gpu = update_convolutional_layer_gpu;
 
     if(gpu_index >= 0){
-        if (adam) {
-            l.m_gpu = cuda_make_array(l.m, c*n*size*size);
-            l.v_gpu = cuda_make_array(l.v, c*n*size*size);
+        if (adam && train) {
+            l.m_gpu = cuda_make_array(l.m, l.nweights);
+            l.v_gpu = cuda_make_array(l.v, l.nweights);
             l.bias_m_gpu = cuda_make_array(l.bias_m, n);
             l.bias_v_gpu = cuda_make_array(l.bias_v, n);
             l.scale_m_gpu = cuda_make_array(l.scale_m, n);
             l.scale_v_gpu = cuda_make_array(l.scale_v, n);
         }
 
-        l.weights_gpu = cuda_make_array(l.weights, c*n*size*size);
-        l.weight_updates_gpu = cuda_make_array(l.weight_updates, c*n*size*size);
-
+        l.weights_gpu = cuda_make_array(l.weights, l.nweights);
         l.biases_gpu = cuda_make_array(l.biases, n);
-        l.bias_updates_gpu = cuda_make_array(l.bias_updates, n);
-
-        l.delta_gpu = cuda_make_array(l.delta, l.batch*out_h*out_w*n);
         l.output_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
 
+        if(train){
+            l.weight_updates_gpu = cuda_make_array(l.weight_updates, l.nweights);
+            l.bias_updates_gpu = cuda_make_array(l.bias_updates, n);
+            l.delta_gpu = cuda_make_array(l.delta, l.batch*out_h*out_w*n);
+        }
+
         if(binary){
-            l.binary_weights_gpu = cuda_make_array(l.weights, c*n*size*size);
+            l.binary_weights_gpu = cuda_make_array(l.weights, l.nweights);
         }
         if(xnor){
-            l.binary_weights_gpu = cuda_make_array(l.weights, c*n*size*size);
+            l.binary_weights_gpu = cuda_make_array(l.weights, l.nweights);
             l.binary_input_gpu = cuda_make_array(0, l.inputs*l.batch);
         }
 
         if(batch_normalize){
-            l.mean_gpu = cuda_make_array(l.mean, n);
-            l.variance_gpu = cuda_make_array(l.variance, n);
+            l.rolling_mean_gpu = cuda_make_array(l.rolling_mean, n);
+            l.rolling_variance_gpu = cuda_make_array(l.rolling_variance, n);
 
-            l.rolling_mean_gpu = cuda_make_array(l.mean, n);
-            l.rolling_variance_gpu = cuda_make_array(l.variance, n);
+            l.scales_gpu = cuda_make_array(l.scales, n);
 
-            l.mean_delta_gpu = cuda_make_array(l.mean, n);
-            l.variance_delta_gpu = cuda_make_array(l.variance, n);
+            if(train){
+                l.mean_gpu = cuda_make_array(l.mean, n);
+                l.variance_gpu = cuda_make_array(l.variance, n);
 
-            l.scales_gpu = cuda_make_array(l.scales, n);
-            l.scale_updates_gpu = cuda_make_array(l.scale_updates, n);
+                l.mean_delta_gpu = cuda_make_array(l.mean, n);
+                l.variance_delta_gpu = cuda_make_array(l.variance, n);
 
-            l.x_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
-            l.x_norm_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
+                l.scale_updates_gpu = cuda_make_array(l.scale_updates, n);
+
+                l.x_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
+                l.x_norm_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
+            }
         }
 #ifdef CUDNN
         cudnnCreateTensorDescriptor(&l.normTensorDesc);
@@ -307,7 +331,8 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.workspace_size = get_workspace_size(l);
     l.activation = activation;
 
-    fprintf(stderr, "conv  %5d %2d x%2d /%2d  %4d x%4d x%4d   ->  %4d x%4d x%4d\n", n, size, size, stride, w, h, c, l.out_w, l.out_h, l.out_c);
+    if(groups > 1) fprintf(stderr, "conv  %5d/%4d %2d x%2d /%2d  %4d x%4d x%4d   ->  %4d x%4d x%4d\n", n, groups, size, size, stride, w, h, c, l.out_w, l.out_h, l.out_c);
+    else fprintf(stderr, "conv  %5d %2d x%2d /%2d  %4d x%4d x%4d   ->  %4d x%4d x%4d\n", n, size, size, stride, w, h, c, l.out_w, l.out_h, l.out_c);
 
     return l;
 }
@@ -317,8 +342,8 @@ void denormalize_convolutional_layer(convolutional_layer l)
     int i, j;
     for(i = 0; i < l.n; ++i){
         float scale = l.scales[i]/sqrt(l.rolling_variance[i] + .00001);
-        for(j = 0; j < l.c*l.size*l.size; ++j){
-            l.weights[i*l.c*l.size*l.size + j] *= scale;
+        for(j = 0; j < l.nweights/l.n; ++j){
+            l.weights[i*l.nweights/l.n + j] *= scale;
         }
         l.biases[i] -= l.rolling_mean[i] * scale;
         l.scales[i] = 1;
@@ -330,7 +355,7 @@ void denormalize_convolutional_layer(convolutional_layer l)
 /*
 void test_convolutional_layer()
 {
-    convolutional_layer l = make_convolutional_layer(1, 5, 5, 3, 2, 5, 2, 1, LEAKY, 1, 0, 0, 0);
+    convolutional_layer l = make_convolutional_layer(1, 5, 5, 3, 2, 1, 5, 2, 1, LEAKY, 1, 0, 0, 0, 1);
     l.batch_normalize = 1;
     float data[] = {1,1,1,1,1,
         1,1,1,1,1,
@@ -366,26 +391,33 @@ void resize_convolutional_layer(convolutional_layer *l, int w, int h)
     l->inputs = l->w * l->h * l->c;
 
     l->output = realloc(l->output, l->batch*l->outputs*sizeof(float));
-    l->delta  = realloc(l->delta,  l->batch*l->outputs*sizeof(float));
-    if(l->batch_normalize){
+    if(l->delta) l->delta  = realloc(l->delta,  l->batch*l->outputs*sizeof(float));
+    if(l->x){
         l->x = realloc(l->x, l->batch*l->outputs*sizeof(float));
         l->x_norm  = realloc(l->x_norm, l->batch*l->outputs*sizeof(float));
     }
+    if(l->binary_input) l->binary_input = realloc(l->binary_input, l->batch*l->inputs*sizeof(float));
 
 #ifdef GPU
-    cuda_free(l->delta_gpu);
     cuda_free(l->output_gpu);
-
-    l->delta_gpu =  cuda_make_array(l->delta,  l->batch*l->outputs);
     l->output_gpu = cuda_make_array(l->output, l->batch*l->outputs);
 
-    if(l->batch_normalize){
+    if(l->delta_gpu){
+        cuda_free(l->delta_gpu);
+        l->delta_gpu =  cuda_make_array(l->delta,  l->batch*l->outputs);
+    }
+
+    if(l->x_gpu){
         cuda_free(l->x_gpu);
         cuda_free(l->x_norm_gpu);
 
         l->x_gpu = cuda_make_array(l->output, l->batch*l->outputs);
         l->x_norm_gpu = cuda_make_array(l->output, l->batch*l->outputs);
     }
+    if(l->binary_input_gpu){
+        cuda_free(l->binary_input_gpu);
+        l->binary_input_gpu = cuda_make_array(0, l->batch*l->inputs);
+    }
 #ifdef CUDNN
     cudnn_convolutional_setup(l);
 #endif
@@ -427,36 +459,85 @@ void backward_bias(float *bias_updates, float *delta, int batch, int n, int size
     }
 }
 
+/* One filter per input channel (times the channel multiplier n/groups), accumulated straight
+   into the output rows so the inner loop vectorizes across the row. */
+static void forward_depthwise_convolution(convolutional_layer l, network net)
+{
+    int b, f, y, i, j, x;
+    int mult = l.n/l.groups;
+    for(b = 0; b < l.batch; ++b){
+        for(f = 0; f < l.n; ++f){
+            float *im = net.input + (b*l.c + f/mult)*l.h*l.w;
+            float *w = l.weights + f*l.size*l.size;
+            float *out = l.output + (b*l.n + f)*l.out_h*l.out_w;
+            for(j = 0; j < l.size; ++j){
+                int lo = (l.pad > j) ? (l.pad - j + l.stride - 1)/l.stride : 0;
+                int hi = (l.w - 1 + l.pad - j >= 0) ? (l.w - 1 + l.pad - j)/l.stride + 1 : 0;
+                if(hi > l.out_w) hi = l.out_w;
+                for(y = 0; y < l.out_h; ++y){
+                    float *o = out + y*l.out_w;
+                    for(i = 0; i < l.size; ++i){
+                        int iy = y*l.stride + i - l.pad;
+                        if(iy < 0 || iy >= l.h) continue;
+                        float v = w[i*l.size + j];
+                        float *row = im + iy*l.w + j - l.pad;
+                        if(l.stride == 1){
+                            for(x = lo; x < hi; ++x) o[x] += v*row[x];
+                        } else {
+                            for(x = lo; x < hi; ++x) o[x] += v*row[x*l.stride];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 void forward_convolutional_layer(convolutional_layer l, network net)
 {
     int out_h = l.out_h;
     int out_w = l.out_w;
-    int i;
-
-    fill_cpu(l.outputs*l.batch, 0, l.output, 1);
+    int i, j;
 
-    if(l.xnor){
-        binarize_weights(l.weights, l.n, l.c*l.size*l.size, l.binary_weights);
-        swap_binary(&l);
-        binarize_cpu(net.input, l.c*l.h*l.w*l.batch, l.binary_input);
-        net.input = l.binary_input;
+    if(l.quantized){
+        forward_quantized_layer(l, net);
+        return;
     }
 
-    int m = l.n;
-    int k = l.size*l.size*l.c;
-    int n = out_h*out_w;
+    fill_cpu(l.outputs*l.batch, 0, l.output, 1);
 
+    int m = l.n/l.groups;
+    int k = l.size*l.size*l.c/l.groups;
+    int n = out_h*out_w;
 
-    float *a = l.weights;
-    float *b = net.workspace;
-    float *c = l.output;
+    if(l.bitpacked){
+        forward_bitpacked_convolution(l, net);
+    } else if(l.winograd){
+        forward_winograd_convolution(l, net);
+    } else if(l.groups > 1 && l.groups == l.c && !l.xnor){
+        forward_depthwise_convolution(l, net);
+    } else {
+        if(l.xnor){
+            binarize_weights(l.weights, l.n, k, l.binary_weights);
+            swap_binary(&l);
+            binarize_cpu(net.input, l.c*l.h*l.w*l.batch, l.binary_input);
+            net.input = l.binary_input;
+        }
 
-    for(i = 0; i < l.batch; ++i){
-        im2col_cpu(net.input, l.c, l.h, l.w,
-                l.size, l.stride, l.pad, b);
-        gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
-        c += n*m;
-        net.input += l.c*l.h*l.w;
+        float *b = net.workspace;
+        float *c = l.output;
+
+        for(i = 0; i < l.batch; ++i){
+            for(j = 0; j < l.groups; ++j){
+                float *a = l.weights + j*l.nweights/l.groups;
+                im2col_cpu(net.input, l.c/l.groups, l.h, l.w,
+                        l.size, l.stride, l.pad, b);
+                if(l.half) gemm_half_nn(m,n,k,l.half_weights,l.half,b,c,b + (size_t)n*k);
+                else gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
+                c += n*m;
+                net.input += l.c/l.groups*l.h*l.w;
+            }
+        }
     }
 
     if(l.batch_normalize){
@@ -465,18 +546,18 @@ void forward_convolutional_layer(convolutional_layer l, network net)
         add_bias(l.output, l.biases, l.batch, l.n, out_h*out_w);
     }
 
-    activate_array(l.output, m*n*l.batch, l.activation);
-    if(l.binary || l.xnor) swap_binary(&l);
+    activate_array(l.output, l.outputs*l.batch, l.activation);
+    if(l.binary || (l.xnor && !l.bitpacked)) swap_binary(&l);
 }
 
 void backward_convolutional_layer(convolutional_layer l, network net)
 {
-    int i;
-    int m = l.n;
-    int n = l.size*l.size*l.c;
+    int i, j;
+    int m = l.n/l.groups;
+    int n = l.size*l.size*l.c/l.groups;
     int k = l.out_w*l.out_h;
 
-    gradient_array(l.output, m*k*l.batch, l.activation, l.delta);
+    gradient_array(l.output, l.n*k*l.batch, l.activation, l.delta);
 
     if(l.batch_normalize){
         backward_batchnorm_layer(l, net);
@@ -485,31 +566,33 @@ void backward_convolutional_layer(convolutional_layer l, network net)
     }
 
     for(i = 0; i < l.batch; ++i){
-        float *a = l.delta + i*m*k;
-        float *b = net.workspace;
-        float *c = l.weight_updates;
+        for(j = 0; j < l.groups; ++j){
+            float *a = l.delta + (i*l.groups + j)*m*k;
+            float *b = net.workspace;
+            float *c = l.weight_updates + j*l.nweights/l.groups;
 
-        float *im = net.input+i*l.c*l.h*l.w;
+            float *im = net.input + (i*l.groups + j)*l.c/l.groups*l.h*l.w;
 
-        im2col_cpu(im, l.c, l.h, l.w,
-                l.size, l.stride, l.pad, b);
-        gemm(0,1,m,n,k,1,a,k,b,k,1,c,n);
+            im2col_cpu(im, l.c/l.groups, l.h, l.w,
+                    l.size, l.stride, l.pad, b);
+            gemm(0,1,m,n,k,1,a,k,b,k,1,c,n);
 
-        if(net.delta){
-            a = l.weights;
-            b = l.delta + i*m*k;
-            c = net.workspace;
+            if(net.delta){
+                a = l.weights + j*l.nweights/l.groups;
+                b = l.delta + (i*l.groups + j)*m*k;
+                c = net.workspace;
 
-            gemm(1,0,n,k,m,1,a,n,b,k,0,c,k);
+                gemm(1,0,n,k,m,1,a,n,b,k,0,c,k);
 
-            col2im_cpu(net.workspace, l.c,  l.h,  l.w,  l.size,  l.stride, l.pad, net.delta+i*l.c*l.h*l.w);
+                col2im_cpu(net.workspace, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, net.delta + (i*l.groups + j)*l.c/l.groups*l.h*l.w);
+            }
         }
     }
 }
 
 void update_convolutional_layer(convolutional_layer l, int batch, float learning_rate, float momentum, float decay)
 {
-    int size = l.size*l.size*l.c*l.n;
+    int size = l.nweights;
     axpy_cpu(l.n, learning_rate/batch, l.bias_updates, 1, l.biases, 1);
     scal_cpu(l.n, momentum, l.bias_updates, 1);
 
@@ -528,7 +611,7 @@ image get_convolutional_weight(convolutional_layer l, int i)
 {
     int h = l.size;
     int w = l.size;
-    int c = l.c;
+    int c = l.c/l.groups;
     return float_to_image(w,h,c,l.weights+i*h*w*c);
 }
 
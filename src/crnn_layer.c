@@ -48,17 +48,17 @@ layer make_crnn_layer(int batch, int h, int w, int c, int hidden_filters, int ou
 
     l.input_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.input_layer) = make_convolutional_layer(batch*steps, h, w, c, hidden_filters, 3, 1, 1,  activation, batch_normalize, 0, 0, 0);
+    *(l.input_layer) = make_convolutional_layer(batch*steps, h, w, c, hidden_filters, 1, 3, 1, 1,  activation, batch_normalize, 0, 0, 0, 1);
     l.input_layer->batch = batch;
 
     l.self_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.self_layer) = make_convolutional_layer(batch*steps, h, w, hidden_filters, hidden_filters, 3, 1, 1,  activation, batch_normalize, 0, 0, 0);
+    *(l.self_layer) = make_convolutional_layer(batch*steps, h, w, hidden_filters, hidden_filters, 1, 3, 1, 1,  activation, batch_normalize, 0, 0, 0, 1);
     l.self_layer->batch = batch;
 
     l.output_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.output_layer) = make_convolutional_layer(batch*steps, h, w, hidden_filters, output_filters, 3, 1, 1,  activation, batch_normalize, 0, 0, 0);
+    *(l.output_layer) = make_convolutional_layer(batch*steps, h, w, hidden_filters, output_filters, 1, 3, 1, 1,  activation, batch_normalize, 0, 0, 0, 1);
     l.output_layer->batch = batch;
 
     l.output = l.output_layer->output;
@@ -81,6 +81,34 @@ layer make_crnn_layer(int batch, int h, int w, int c, int hidden_filters, int ou
     return l;
 }
 
+static void resize_step_layer(layer *s, int batch, int steps)
+{
+    s->batch = batch*steps;
+    resize_convolutional_layer(s, s->w, s->h);
+    s->batch = batch;
+}
+
+void resize_crnn_layer(layer *l, int w, int h)
+{
+    if(w != l->w || h != l->h) error("CRNN layer input cannot change size");
+    resize_step_layer(l->input_layer, l->batch, l->steps);
+    resize_step_layer(l->self_layer, l->batch, l->steps);
+    resize_step_layer(l->output_layer, l->batch, l->steps);
+    l->workspace_size = l->input_layer->workspace_size;
+    if(l->self_layer->workspace_size > l->workspace_size) l->workspace_size = l->self_layer->workspace_size;
+    if(l->output_layer->workspace_size > l->workspace_size) l->workspace_size = l->output_layer->workspace_size;
+
+    l->state = realloc(l->state, l->hidden*l->batch*(l->steps+1)*sizeof(float));
+    l->output = l->output_layer->output;
+    l->delta = l->output_layer->delta;
+#ifdef GPU
+    cuda_free(l->state_gpu);
+    l->state_gpu = cuda_make_array(l->state, l->hidden*l->batch*(l->steps+1));
+    l->output_gpu = l->output_layer->output_gpu;
+    l->delta_gpu = l->output_layer->delta_gpu;
+#endif
+}
+
 void update_crnn_layer(layer l, int batch, float learning_rate, float momentum, float decay)
 {
     update_convolutional_layer(*(l.input_layer), batch, learning_rate, momentum, decay);
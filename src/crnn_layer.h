@@ -11,6 +11,7 @@ layer make_crnn_layer(int batch, int h, int w, int c, int hidden_filters, int ou
 void forward_crnn_layer(layer l, network net);
 void backward_crnn_layer(layer l, network net);
 void update_crnn_layer(layer l, int batch, float learning_rate, float momentum, float decay);
+void resize_crnn_layer(layer *l, int w, int h);
 
 #ifdef GPU
 void forward_crnn_layer_gpu(layer l, network net);
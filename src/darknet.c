@@ -7,6 +7,9 @@
 #include "cuda.h"
 #include "blas.h"
 #include "connected_layer.h"
+#include "mapped_weights.h"
+#include "quantize.h"
+#include "half.h"
 
 extern void predict_classifier(char *datacfg, char *cfgfile, char *weightfile, char *filename, int top);
 extern void test_detector(char *datacfg, char *cfgfile, char *weightfile, char *filename, float thresh, float hier_thresh, char *outfile, int fullscreen);
@@ -29,6 +32,8 @@ extern void run_go(int argc, char **argv);
 extern void run_art(int argc, char **argv);
 extern void run_super(int argc, char **argv);
 extern void run_lsd(int argc, char **argv);
+extern void run_bench(int argc, char **argv);
+extern void run_ring(int argc, char **argv);
 
 void average(int argc, char *argv[])
 {
@@ -50,7 +55,7 @@ void average(int argc, char *argv[])
             layer l = net.layers[j];
             layer out = sum.layers[j];
             if(l.type == CONVOLUTIONAL){
-                int num = l.n*l.c*l.size*l.size;
+                int num = l.nweights;
                 axpy_cpu(l.n, 1, l.biases, 1, out.biases, 1);
                 axpy_cpu(num, 1, l.weights, 1, out.weights, 1);
                 if(l.batch_normalize){
@@ -69,7 +74,7 @@ void average(int argc, char *argv[])
     for(j = 0; j < net.n; ++j){
         layer l = sum.layers[j];
         if(l.type == CONVOLUTIONAL){
-            int num = l.n*l.c*l.size*l.size;
+            int num = l.nweights;
             scal_cpu(l.n, 1./n, l.biases, 1);
             scal_cpu(num, 1./n, l.weights, 1);
                 if(l.batch_normalize){
@@ -112,7 +117,7 @@ void operations(char *cfgfile)
     for(i = 0; i < net.n; ++i){
         layer l = net.layers[i];
         if(l.type == CONVOLUTIONAL){
-            ops += 2l * l.n * l.size*l.size*l.c * l.out_h*l.out_w;
+            ops += 2l * l.nweights * l.out_h*l.out_w;
         } else if(l.type == CONNECTED){
             ops += 2l * l.inputs * l.outputs;
         }
@@ -121,6 +126,30 @@ void operations(char *cfgfile)
     printf("Floating Point Operations: %.2f Bn\n", (float)ops/1000000000.);
 }
 
+void profile(char *cfgfile, char *weightfile, int batch, int iters, char *tracefile)
+{
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
+    if(weightfile){
+        load_weights(&net, weightfile);
+    }
+    set_batch_network(&net, batch);
+    image im = make_image(net.w, net.h, net.c*net.batch);
+    int i;
+    for(i = 0; i < im.w*im.h*im.c; ++i) im.data[i] = rand_uniform(0, 1);
+    network_predict(net, im.data);
+    net.prof = make_profiler(net, tracefile != 0);
+    for(i = 0; i < iters; ++i){
+        network_predict(net, im.data);
+    }
+    print_profiler(net);
+    if(tracefile){
+        save_profiler_trace(net, tracefile);
+        fprintf(stderr, "Trace written to %s\n", tracefile);
+    }
+    free_image(im);
+    free_network(net);
+}
+
 void oneoff(char *cfgfile, char *weightfile, char *outfile)
 {
     gpu_index = -1;
@@ -190,6 +219,24 @@ void rescale_net(char *cfgfile, char *weightfile, char *outfile)
     save_weights(net, outfile);
 }
 
+void convert_weights(char *cfgfile, char *weightfile, char *outfile, char *half)
+{
+    gpu_index = -1;
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
+    load_weights(&net, weightfile);
+    if(half){
+        half_type type = get_half_type(half);
+        int i;
+        for(i = 0; i < net.n; ++i){
+            layer *l = net.layers + i;
+            if(l->quantized || l->half || l->binary || l->xnor || (l->type == CONVOLUTIONAL && l->groups > 1)) continue;
+            if(l->type == CONVOLUTIONAL || l->type == CONNECTED) convert_layer_to_half(&net, l, type);
+        }
+    }
+    save_mapped_weights(net, outfile);
+    free_network(net);
+}
+
 void rgbgr_net(char *cfgfile, char *weightfile, char *outfile)
 {
     gpu_index = -1;
@@ -472,10 +519,25 @@ int main(int argc, char **argv)
         normalize_net(argv[2], argv[3], argv[4]);
     } else if (0 == strcmp(argv[1], "rescale")){
         rescale_net(argv[2], argv[3], argv[4]);
+    } else if (0 == strcmp(argv[1], "convert")){
+        char *half = find_char_arg(argc, argv, "-half", 0);
+        convert_weights(argv[2], argv[3], argv[4], half);
+    } else if (0 == strcmp(argv[1], "quantize")){
+        int samples = find_int_arg(argc, argv, "-samples", 100);
+        quantize_network(argv[2], argv[3], argv[4], argv[5], samples);
     } else if (0 == strcmp(argv[1], "ops")){
         operations(argv[2]);
     } else if (0 == strcmp(argv[1], "speed")){
         speed(argv[2], (argc > 3 && argv[3]) ? atoi(argv[3]) : 0);
+    } else if (0 == strcmp(argv[1], "bench")){
+        run_bench(argc, argv);
+    } else if (0 == strcmp(argv[1], "ring")){
+        run_ring(argc, argv);
+    } else if (0 == strcmp(argv[1], "profile")){
+        int batch = find_int_arg(argc, argv, "-batch", 1);
+        int iters = find_int_arg(argc, argv, "-iters", 10);
+        char *trace = find_char_arg(argc, argv, "-trace", 0);
+        profile(argv[2], (argc > 3 && argv[3]) ? argv[3] : 0, batch, iters, trace);
     } else if (0 == strcmp(argv[1], "oneoff")){
         oneoff(argv[2], argv[3], argv[4]);
     } else if (0 == strcmp(argv[1], "oneoff2")){
@@ -7,6 +7,8 @@
 #include "box.h"
 #include "image.h"
 #include "demo.h"
+#include "memory_planner.h"
+#include "tracker.h"
 #include <sys/time.h>
 
 #define DEMO 1
@@ -39,17 +41,9 @@ static int demo_done = 0;
 static float *last_avg2;
 static float *last_avg;
 static float *avg;
+static tracker *demo_tracker;
 double demo_time;
 
-double get_wall_time()
-{
-    struct timeval time;
-    if (gettimeofday(&time,NULL)){
-        return 0;
-    }
-    return (double)time.tv_sec + (double)time.tv_usec * .000001;
-}
-
 void *detect_in_thread(void *ptr)
 {
     running = 1;
@@ -59,10 +53,14 @@ void *detect_in_thread(void *ptr)
     float *X = buff_letter[(buff_index+2)%3].data;
     float *prediction = network_predict(net, X);
 
-    memcpy(predictions[demo_index], prediction, l.outputs*sizeof(float));
-    mean_arrays(predictions, demo_frame, l.outputs, avg);
-    l.output = last_avg2;
-    if(demo_delay == 0) l.output = avg;
+    if(demo_tracker){
+        l.output = prediction;
+    } else {
+        memcpy(predictions[demo_index], prediction, l.outputs*sizeof(float));
+        mean_arrays(predictions, demo_frame, l.outputs, avg);
+        l.output = last_avg2;
+        if(demo_delay == 0) l.output = avg;
+    }
     if(l.type == DETECTION){
         get_detection_boxes(l, 1, 1, demo_thresh, probs, boxes, 0);
     } else if (l.type == REGION){
@@ -71,6 +69,7 @@ void *detect_in_thread(void *ptr)
         error("Last layer must produce detections\n");
     }
     if (nms > 0) do_nms_obj(boxes, probs, l.w*l.h*l.n, l.classes, nms);
+    if (demo_tracker) track_detections(demo_tracker, boxes, probs, l.w*l.h*l.n, l.classes, demo_thresh, 0);
 
     printf("\033[2J");
     printf("\033[1;1H");
@@ -79,7 +78,7 @@ void *detect_in_thread(void *ptr)
     image display = buff[(buff_index+2) % 3];
     draw_detections(display, demo_detections, demo_thresh, boxes, probs, demo_names, demo_alphabet, demo_classes);
 
-    demo_index = (demo_index + 1)%demo_frame;
+    if(!demo_tracker) demo_index = (demo_index + 1)%demo_frame;
     running = 0;
     return 0;
 }
@@ -133,10 +132,11 @@ void *detect_loop(void *ptr)
     }
 }
 
-void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const char *filename, char **names, int classes, int delay, char *prefix, int avg_frames, float hier, int w, int h, int frames, int fullscreen)
+void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const char *filename, char **names, int classes, int delay, char *prefix, int avg_frames, float hier, int w, int h, int frames, int fullscreen, int track)
 {
     demo_delay = delay;
-    demo_frame = avg_frames;
+    demo_frame = track ? 0 : avg_frames;
+    if(track) demo_tracker = make_tracker(.3, 3);
     predictions = calloc(demo_frame, sizeof(float*));
     image **alphabet = load_alphabet();
     demo_names = names;
@@ -145,11 +145,12 @@ void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const ch
     demo_thresh = thresh;
     demo_hier = hier;
     printf("Demo\n");
-    net = parse_network_cfg(cfgfile);
+    net = parse_network_cfg_custom(cfgfile, 0, 0);
     if(weightfile){
         load_weights(&net, weightfile);
     }
     set_batch_network(&net, 1);
+    plan_network_memory(&net);
     pthread_t detect_thread;
     pthread_t fetch_thread;
 
@@ -233,7 +234,7 @@ void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const ch
     }
 }
 #else
-void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const char *filename, char **names, int classes, int delay, char *prefix, int avg, float hier, int w, int h, int frames, int fullscreen)
+void demo(char *cfgfile, char *weightfile, float thresh, int cam_index, const char *filename, char **names, int classes, int delay, char *prefix, int avg, float hier, int w, int h, int frames, int fullscreen, int track)
 {
     fprintf(stderr, "Demo needs OpenCV for webcam images.\n");
 }
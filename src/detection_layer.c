@@ -46,6 +46,19 @@ detection_layer make_detection_layer(int batch, int inputs, int n, int side, int
     return l;
 }
 
+void resize_detection_layer(detection_layer *l, int inputs)
+{
+    if(inputs != l->inputs) error("Detection layer inputs cannot change size");
+    l->output = realloc(l->output, l->batch*l->outputs*sizeof(float));
+    l->delta = realloc(l->delta, l->batch*l->outputs*sizeof(float));
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    l->output_gpu = cuda_make_array(l->output, l->batch*l->outputs);
+    l->delta_gpu = cuda_make_array(l->delta, l->batch*l->outputs);
+#endif
+}
+
 void forward_detection_layer(const detection_layer l, network net)
 {
     int locations = l.side*l.side;
@@ -9,6 +9,7 @@ typedef layer detection_layer;
 detection_layer make_detection_layer(int batch, int inputs, int n, int size, int classes, int coords, int rescore);
 void forward_detection_layer(const detection_layer l, network net);
 void backward_detection_layer(const detection_layer l, network net);
+void resize_detection_layer(detection_layer *l, int inputs);
 void get_detection_boxes(layer l, int w, int h, float thresh, float **probs, box *boxes, int only_objectness);
 
 #ifdef GPU
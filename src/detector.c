@@ -8,10 +8,15 @@
 #include "option_list.h"
 #include "blas.h"
 #include "test_calling_from_python.h"
+#include "tta.h"
+#include "memory_planner.h"
+#include "replica.h"
+#include "ring.h"
+#include "pipeline.h"
 
 static int coco_ids[] = {1,2,3,4,5,6,7,8,9,10,11,13,14,15,16,17,18,19,20,21,22,23,24,25,27,28,31,32,33,34,35,36,37,38,39,40,41,42,43,44,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,61,62,63,64,65,67,70,72,73,74,75,76,77,78,79,80,81,82,84,85,86,87,88,89,90};
 
-void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, int ngpus, int clear)
+void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, int ngpus, int clear, ring *r)
 {
     list *options = read_data_cfg(datacfg);
     char *train_images = option_find_str(options, "train", "");
@@ -37,7 +42,11 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
         }
         if(clear) *nets[i].seen = 0;
         nets[i].learning_rate *= ngpus;
+        if(r) nets[i].learning_rate *= r->size;
     }
+#ifndef GPU
+    if(ngpus > 1) share_network_weights(nets, ngpus);
+#endif
     srand(time(0));
     network net = nets[0];
 
@@ -54,13 +63,18 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
     int N = plist->size;
     printf("N = %d, filename = %s\n", N, train_images);
     char **paths = (char **)list_to_array(plist);
+    if(r){
+        char **all = paths;
+        paths = ring_shard_paths(r, paths, &N);
+        free(all);
+    }
 
     load_args args = {0};
     args.w = net.w;
     args.h = net.h;
     args.paths = paths;
     args.n = imgs;
-    args.m = plist->size;
+    args.m = N;
     args.classes = classes;
     args.jitter = jitter;
     args.num_boxes = l.max_boxes;
@@ -74,9 +88,10 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
     args.hue = net.hue;
 
     pthread_t load_thread = load_data(args);
-    clock_t time;
+    double time;
     int count = 0;
     //while(i*imgs < N*120){
+    int steps = 0;
     while(get_current_batch(net) < net.max_batches){
         if(l.random && count++%10 == 0){
             printf("Resizing\n");
@@ -97,7 +112,7 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
             }
             net = nets[0];
         }
-        time=clock();
+        time=get_wall_time();
         pthread_join(load_thread, 0);
         train = buffer;
         load_thread = load_data(args);
@@ -126,9 +141,9 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
         }
         */
 
-        printf("Loaded: %lf seconds\n", sec(clock()-time));
+        printf("Loaded: %lf seconds\n", get_wall_time()-time);
 
-        time=clock();
+        time=get_wall_time();
         float loss = 0;
 #ifdef GPU
         if(ngpus == 1){
@@ -137,37 +152,55 @@ void train_detector(char *datacfg, char *cfgfile, char *weightfile, int *gpus, i
             loss = train_networks(nets, ngpus, train, 4);
         }
 #else
-        loss = train_network(net, train);
+        if(ngpus == 1){
+            loss = train_network(net, train);
+        } else {
+            loss = train_network_replicas(nets, ngpus, train);
+        }
 #endif
+        if(r && ++steps == 4){
+            sync_ring(r, nets, ngpus, steps);
+            steps = 0;
+        }
         if (avg_loss < 0) avg_loss = loss;
         avg_loss = avg_loss*.9 + loss*.1;
 
         i = get_current_batch(net);
-        printf("%d: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), loss, avg_loss, get_current_rate(net), sec(clock()-time), i*imgs);
+        printf("%d: %f, %f avg, %f rate, %lf seconds, %d images\n", get_current_batch(net), loss, avg_loss, get_current_rate(net), get_wall_time()-time, i*imgs);
         if(i%1000==0){
 #ifdef GPU
             if(ngpus != 1) sync_nets(nets, ngpus, 0);
 #endif
+            if(r){
+                sync_ring(r, nets, ngpus, steps);
+                steps = 0;
+            }
             char buff[256];
             sprintf(buff, "%s/%s.backup", backup_directory, base);
-            save_weights(net, buff);
+            if(!r || !r->rank) save_weights(net, buff);
         }
         if(i%10000==0 || (i < 1000 && i%100 == 0)){
 #ifdef GPU
             if(ngpus != 1) sync_nets(nets, ngpus, 0);
 #endif
+            if(r){
+                sync_ring(r, nets, ngpus, steps);
+                steps = 0;
+            }
             char buff[256];
             sprintf(buff, "%s/%s_%d.weights", backup_directory, base, i);
-            save_weights(net, buff);
+            if(!r || !r->rank) save_weights(net, buff);
         }
         free_data(train);
     }
 #ifdef GPU
     if(ngpus != 1) sync_nets(nets, ngpus, 0);
 #endif
+    if(r) sync_ring(r, nets, ngpus, steps);
     char buff[256];
     sprintf(buff, "%s/%s_final.weights", backup_directory, base);
-    save_weights(net, buff);
+    if(!r || !r->rank) save_weights(net, buff);
+    free_ring(r);
 }
 
 
@@ -246,7 +279,7 @@ void print_imagenet_detections(FILE *fp, int id, box *boxes, float **probs, int
     }
 }
 
-void validate_detector_flip(char *datacfg, char *cfgfile, char *weightfile, char *outfile)
+void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *outfile, char *tta_list)
 {
     int j;
     list *options = read_data_cfg(datacfg);
@@ -258,147 +291,18 @@ void validate_detector_flip(char *datacfg, char *cfgfile, char *weightfile, char
     int *map = 0;
     if (mapf) map = read_map(mapf);
 
-    network net = parse_network_cfg(cfgfile);
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
     if(weightfile){
         load_weights(&net, weightfile);
     }
-    set_batch_network(&net, 2);
-    fprintf(stderr, "Learning Rate: %g, Momentum: %g, Decay: %g\n", net.learning_rate, net.momentum, net.decay);
-    srand(time(0));
-
-    list *plist = get_paths(valid_images);
-    char **paths = (char **)list_to_array(plist);
-
-    layer l = net.layers[net.n-1];
-    int classes = l.classes;
-
-    char buff[1024];
-    char *type = option_find_str(options, "eval", "voc");
-    FILE *fp = 0;
-    FILE **fps = 0;
-    int coco = 0;
-    int imagenet = 0;
-    if(0==strcmp(type, "coco")){
-        if(!outfile) outfile = "coco_results";
-        snprintf(buff, 1024, "%s/%s.json", prefix, outfile);
-        fp = fopen(buff, "w");
-        fprintf(fp, "[\n");
-        coco = 1;
-    } else if(0==strcmp(type, "imagenet")){
-        if(!outfile) outfile = "imagenet-detection";
-        snprintf(buff, 1024, "%s/%s.txt", prefix, outfile);
-        fp = fopen(buff, "w");
-        imagenet = 1;
-        classes = 200;
+    tta_config tta = {0};
+    if(tta_list){
+        tta = parse_tta(tta_list);
+        set_batch_tta(&net, tta);
     } else {
-        if(!outfile) outfile = "comp4_det_test_";
-        fps = calloc(classes, sizeof(FILE *));
-        for(j = 0; j < classes; ++j){
-            snprintf(buff, 1024, "%s/%s%s.txt", prefix, outfile, names[j]);
-            fps[j] = fopen(buff, "w");
-        }
-    }
-
-
-    box *boxes = calloc(l.w*l.h*l.n, sizeof(box));
-    float **probs = calloc(l.w*l.h*l.n, sizeof(float *));
-    for(j = 0; j < l.w*l.h*l.n; ++j) probs[j] = calloc(classes+1, sizeof(float *));
-
-    int m = plist->size;
-    int i=0;
-    int t;
-
-    float thresh = .005;
-    float nms = .45;
-
-    int nthreads = 4;
-    image *val = calloc(nthreads, sizeof(image));
-    image *val_resized = calloc(nthreads, sizeof(image));
-    image *buf = calloc(nthreads, sizeof(image));
-    image *buf_resized = calloc(nthreads, sizeof(image));
-    pthread_t *thr = calloc(nthreads, sizeof(pthread_t));
-
-    image input = make_image(net.w, net.h, net.c*2);
-
-    load_args args = {0};
-    args.w = net.w;
-    args.h = net.h;
-    //args.type = IMAGE_DATA;
-    args.type = LETTERBOX_DATA;
-
-    for(t = 0; t < nthreads; ++t){
-        args.path = paths[i+t];
-        args.im = &buf[t];
-        args.resized = &buf_resized[t];
-        thr[t] = load_data_in_thread(args);
+        set_batch_network(&net, 1);
     }
-    time_t start = time(0);
-    for(i = nthreads; i < m+nthreads; i += nthreads){
-        fprintf(stderr, "%d\n", i);
-        for(t = 0; t < nthreads && i+t-nthreads < m; ++t){
-            pthread_join(thr[t], 0);
-            val[t] = buf[t];
-            val_resized[t] = buf_resized[t];
-        }
-        for(t = 0; t < nthreads && i+t < m; ++t){
-            args.path = paths[i+t];
-            args.im = &buf[t];
-            args.resized = &buf_resized[t];
-            thr[t] = load_data_in_thread(args);
-        }
-        for(t = 0; t < nthreads && i+t-nthreads < m; ++t){
-            char *path = paths[i+t-nthreads];
-            char *id = basecfg(path);
-            copy_cpu(net.w*net.h*net.c, val_resized[t].data, 1, input.data, 1);
-            flip_image(val_resized[t]);
-            copy_cpu(net.w*net.h*net.c, val_resized[t].data, 1, input.data + net.w*net.h*net.c, 1);
-
-            network_predict(net, input.data);
-            int w = val[t].w;
-            int h = val[t].h;
-            get_region_boxes(l, w, h, net.w, net.h, thresh, probs, boxes, 0, map, .5, 0);
-            if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, classes, nms);
-            if (coco){
-                print_cocos(fp, path, boxes, probs, l.w*l.h*l.n, classes, w, h);
-            } else if (imagenet){
-                print_imagenet_detections(fp, i+t-nthreads+1, boxes, probs, l.w*l.h*l.n, classes, w, h);
-            } else {
-                print_detector_detections(fps, id, boxes, probs, l.w*l.h*l.n, classes, w, h);
-            }
-            free(id);
-            free_image(val[t]);
-            free_image(val_resized[t]);
-        }
-    }
-    for(j = 0; j < classes; ++j){
-        if(fps) fclose(fps[j]);
-    }
-    if(coco){
-        fseek(fp, -2, SEEK_CUR);
-        fprintf(fp, "\n]\n");
-        fclose(fp);
-    }
-    fprintf(stderr, "Total Detection Time: %f Seconds\n", (double)(time(0) - start));
-}
-
-
-void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *outfile)
-{
-    int j;
-    list *options = read_data_cfg(datacfg);
-    char *valid_images = option_find_str(options, "valid", "data/train.list");
-    char *name_list = option_find_str(options, "names", "data/names.list");
-    char *prefix = option_find_str(options, "results", "results");
-    char **names = get_labels(name_list);
-    char *mapf = option_find_str(options, "map", 0);
-    int *map = 0;
-    if (mapf) map = read_map(mapf);
-
-    network net = parse_network_cfg(cfgfile);
-    if(weightfile){
-        load_weights(&net, weightfile);
-    }
-    set_batch_network(&net, 1);
+    plan_network_memory(&net);
     fprintf(stderr, "Learning Rate: %g, Momentum: %g, Decay: %g\n", net.learning_rate, net.momentum, net.decay);
     srand(time(0));
 
@@ -436,9 +340,10 @@ void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *out
     }
 
 
-    box *boxes = calloc(l.w*l.h*l.n, sizeof(box));
-    float **probs = calloc(l.w*l.h*l.n, sizeof(float *));
-    for(j = 0; j < l.w*l.h*l.n; ++j) probs[j] = calloc(classes+1, sizeof(float *));
+    int total = tta_boxes(tta, net);
+    box *boxes = calloc(total, sizeof(box));
+    float **probs = calloc(total, sizeof(float *));
+    for(j = 0; j < total; ++j) probs[j] = calloc(classes+1, sizeof(float *));
 
     int m = plist->size;
     int i=0;
@@ -463,7 +368,7 @@ void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *out
     for(t = 0; t < nthreads; ++t){
         args.path = paths[i+t];
         args.im = &buf[t];
-        args.resized = &buf_resized[t];
+        args.resized = tta.n ? 0 : &buf_resized[t];
         thr[t] = load_data_in_thread(args);
     }
     time_t start = time(0);
@@ -477,24 +382,28 @@ void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *out
         for(t = 0; t < nthreads && i+t < m; ++t){
             args.path = paths[i+t];
             args.im = &buf[t];
-            args.resized = &buf_resized[t];
+            args.resized = tta.n ? 0 : &buf_resized[t];
             thr[t] = load_data_in_thread(args);
         }
         for(t = 0; t < nthreads && i+t-nthreads < m; ++t){
             char *path = paths[i+t-nthreads];
             char *id = basecfg(path);
-            float *X = val_resized[t].data;
-            network_predict(net, X);
             int w = val[t].w;
             int h = val[t].h;
-            get_region_boxes(l, w, h, net.w, net.h, thresh, probs, boxes, 0, map, .5, 0);
-            if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, classes, nms);
+            int num = l.w*l.h*l.n;
+            if(tta.n){
+                num = tta_predict(tta, net, val[t], thresh, nms, boxes, probs, map, .5, 0);
+            } else {
+                network_predict(net, val_resized[t].data);
+                get_region_boxes(l, w, h, net.w, net.h, thresh, probs, boxes, 0, map, .5, 0);
+            }
+            if (nms) do_nms_sort(boxes, probs, num, classes, nms);
             if (coco){
-                print_cocos(fp, path, boxes, probs, l.w*l.h*l.n, classes, w, h);
+                print_cocos(fp, path, boxes, probs, num, classes, w, h);
             } else if (imagenet){
-                print_imagenet_detections(fp, i+t-nthreads+1, boxes, probs, l.w*l.h*l.n, classes, w, h);
+                print_imagenet_detections(fp, i+t-nthreads+1, boxes, probs, num, classes, w, h);
             } else {
-                print_detector_detections(fps, id, boxes, probs, l.w*l.h*l.n, classes, w, h);
+                print_detector_detections(fps, id, boxes, probs, num, classes, w, h);
             }
             free(id);
             free_image(val[t]);
@@ -509,6 +418,7 @@ void validate_detector(char *datacfg, char *cfgfile, char *weightfile, char *out
         fprintf(fp, "\n]\n");
         fclose(fp);
     }
+    free_tta(tta);
     fprintf(stderr, "Total Detection Time: %f Seconds\n", (double)(time(0) - start));
 }
 
@@ -592,6 +502,326 @@ void validate_detector_recall(char *datacfg, char *cfgfile, char *weightfile)
     }
 }
 
+#define MAP_IOUS 10
+
+typedef struct{
+    float prob;
+    int tp;
+} map_detection;
+
+typedef struct{
+    int n;
+    int size;
+    map_detection *dets;
+} map_class;
+
+typedef struct{
+    network net;
+    char **paths;
+    int m;
+    int shard;
+    int shards;
+    float thresh;
+    float nms;
+    int classes;
+    int *truths;
+    map_class *dets;
+    tta_config tta;
+} map_shard_args;
+
+static float map_iou_thresh(int t)
+{
+    return .5 + .05*t;
+}
+
+static void map_add_detection(map_class *c, float prob, int tp)
+{
+    if(c->n == c->size){
+        c->size = c->size ? 2*c->size : 256;
+        c->dets = realloc(c->dets, c->size*sizeof(map_detection));
+    }
+    c->dets[c->n].prob = prob;
+    c->dets[c->n].tp = tp;
+    ++c->n;
+}
+
+static int map_detection_comparator(const void *pa, const void *pb)
+{
+    float diff = ((map_detection *)pa)->prob - ((map_detection *)pb)->prob;
+    if(diff < 0) return 1;
+    else if(diff > 0) return -1;
+    return 0;
+}
+
+/* Greedily match one image's detections to its truths, class by class and
+   for every IoU threshold, and append the outcome to the running lists. */
+static void map_match_image(map_shard_args *a, box *boxes, float **probs, int total, box_label *truth, int num_labels)
+{
+    int i, j, k, t;
+    map_detection *order = calloc(total, sizeof(map_detection));
+    int *used = calloc(num_labels, sizeof(int));
+    for(j = 0; j < num_labels; ++j){
+        if(truth[j].id >= 0 && truth[j].id < a->classes) ++a->truths[truth[j].id];
+    }
+    for(k = 0; k < a->classes; ++k){
+        int n = 0;
+        for(i = 0; i < total; ++i){
+            if(probs[i][k] > 0){
+                order[n].prob = probs[i][k];
+                order[n].tp = i;
+                ++n;
+            }
+        }
+        if(!n) continue;
+        qsort(order, n, sizeof(map_detection), map_detection_comparator);
+        memset(used, 0, num_labels*sizeof(int));
+        for(i = 0; i < n; ++i){
+            box b = boxes[order[i].tp];
+            int tp = 0;
+            for(t = 0; t < MAP_IOUS; ++t){
+                float best_iou = map_iou_thresh(t);
+                int best = -1;
+                for(j = 0; j < num_labels; ++j){
+                    if(truth[j].id != k || (used[j] & (1<<t))) continue;
+                    box tb = {truth[j].x, truth[j].y, truth[j].w, truth[j].h};
+                    float iou = box_iou(b, tb);
+                    if(iou >= best_iou){
+                        best_iou = iou;
+                        best = j;
+                    }
+                }
+                if(best >= 0){
+                    used[best] |= 1<<t;
+                    tp |= 1<<t;
+                }
+            }
+            map_add_detection(a->dets + k, order[i].prob, tp);
+        }
+    }
+    free(order);
+    free(used);
+}
+
+static void *map_shard_thread(void *ptr)
+{
+    map_shard_args *a = ptr;
+    network net = a->net;
+    layer l = net.layers[net.n-1];
+    int total = tta_boxes(a->tta, net);
+    int j;
+    box *boxes = calloc(total, sizeof(box));
+    float **probs = calloc(total, sizeof(float *));
+    for(j = 0; j < total; ++j) probs[j] = calloc(l.classes+1, sizeof(float));
+
+    load_args args = {0};
+    args.w = net.w;
+    args.h = net.h;
+    args.type = LETTERBOX_DATA;
+
+    image val, val_resized, buf;
+    image buf_resized = {0};
+    pthread_t thr;
+    int i = a->shard;
+    int done = 0;
+    if(i < a->m){
+        args.path = a->paths[i];
+        args.im = &buf;
+        args.resized = a->tta.n ? 0 : &buf_resized;
+        thr = load_data_in_thread(args);
+    }
+    for(; i < a->m; i += a->shards){
+        pthread_join(thr, 0);
+        val = buf;
+        val_resized = buf_resized;
+        if(i + a->shards < a->m){
+            args.path = a->paths[i + a->shards];
+            thr = load_data_in_thread(args);
+        }
+
+        char *path = a->paths[i];
+        int num = l.w*l.h*l.n;
+        if(a->tta.n){
+            num = tta_predict(a->tta, net, val, a->thresh, a->nms, boxes, probs, 0, .5, 1);
+        } else {
+            network_predict(net, val_resized.data);
+            get_region_boxes(l, val.w, val.h, net.w, net.h, a->thresh, probs, boxes, 0, 0, .5, 1);
+        }
+        if (a->nms) do_nms_sort(boxes, probs, num, l.classes, a->nms);
+
+        char labelpath[4096];
+        find_replace(path, "images", "labels", labelpath);
+        find_replace(labelpath, "JPEGImages", "labels", labelpath);
+        find_replace(labelpath, ".jpg", ".txt", labelpath);
+        find_replace(labelpath, ".png", ".txt", labelpath);
+        find_replace(labelpath, ".JPG", ".txt", labelpath);
+        find_replace(labelpath, ".JPEG", ".txt", labelpath);
+        int num_labels = 0;
+        box_label *truth = read_boxes(labelpath, &num_labels);
+        map_match_image(a, boxes, probs, num, truth, num_labels);
+        free(truth);
+
+        free_image(val);
+        free_image(val_resized);
+        if(++done % 100 == 0) fprintf(stderr, "shard %d: %d images\n", a->shard, done);
+    }
+    free(boxes);
+    free_ptrs((void **)probs, total);
+    return 0;
+}
+
+/* Area under the precision/recall curve for one class at IoU threshold t.
+   points == 0 integrates every point (VOC2010+), otherwise samples the
+   interpolated precision at that many evenly spaced recalls (COCO uses 101). */
+static float map_average_precision(map_class c, int npos, int t, int points)
+{
+    int i;
+    if(!npos) return 0;
+    float *prec = calloc(c.n + 2, sizeof(float));
+    float *rec = calloc(c.n + 2, sizeof(float));
+    int tp = 0;
+    for(i = 0; i < c.n; ++i){
+        if(c.dets[i].tp & (1<<t)) ++tp;
+        rec[i+1] = (float)tp/npos;
+        prec[i+1] = (float)tp/(i+1);
+    }
+    rec[c.n+1] = 1;
+    for(i = c.n; i >= 0; --i){
+        if(prec[i+1] > prec[i]) prec[i] = prec[i+1];
+    }
+    float ap = 0;
+    if(points){
+        int r;
+        i = 0;
+        for(r = 0; r < points; ++r){
+            float target = (float)r/(points-1);
+            while(i <= c.n && rec[i] < target) ++i;
+            if(i <= c.n) ap += prec[i];
+        }
+        ap /= points;
+    } else {
+        for(i = 1; i <= c.n; ++i){
+            ap += (rec[i] - rec[i-1])*prec[i];
+        }
+    }
+    free(prec);
+    free(rec);
+    return ap;
+}
+
+void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile, int shards, char *tta_list)
+{
+    int i, j, k;
+    list *options = read_data_cfg(datacfg);
+    char *valid_images = option_find_str(options, "valid", "data/train.list");
+    char *name_list = option_find_str(options, "names", "data/names.list");
+    char **names = get_labels(name_list);
+
+    list *plist = get_paths(valid_images);
+    char **paths = (char **)list_to_array(plist);
+    int m = plist->size;
+    if(!m){
+        fprintf(stderr, "No validation images in %s\n", valid_images);
+        free(paths);
+        free_list(plist);
+        return;
+    }
+    if(shards < 1) shards = 1;
+    if(shards > m) shards = m;
+
+    map_shard_args *args = calloc(shards, sizeof(map_shard_args));
+    pthread_t *thr = calloc(shards, sizeof(pthread_t));
+    for(i = 0; i < shards; ++i){
+        network net = parse_network_cfg_custom(cfgfile, 0, 0);
+        if(weightfile){
+            load_weights(&net, weightfile);
+        }
+        if(tta_list){
+            args[i].tta = parse_tta(tta_list);
+            set_batch_tta(&net, args[i].tta);
+        } else {
+            set_batch_network(&net, 1);
+        }
+        plan_network_memory(&net);
+        layer l = net.layers[net.n-1];
+        args[i].net = net;
+        args[i].paths = paths;
+        args[i].m = m;
+        args[i].shard = i;
+        args[i].shards = shards;
+        args[i].thresh = .005;
+        args[i].nms = .45;
+        args[i].classes = l.classes;
+        args[i].truths = calloc(l.classes, sizeof(int));
+        args[i].dets = calloc(l.classes, sizeof(map_class));
+    }
+    srand(time(0));
+
+    double start = get_wall_time();
+    for(i = 0; i < shards; ++i){
+        if(pthread_create(thr + i, 0, map_shard_thread, args + i)) error("Thread creation failed");
+    }
+    for(i = 0; i < shards; ++i){
+        pthread_join(thr[i], 0);
+    }
+
+    int classes = args[0].classes;
+    int *truths = args[0].truths;
+    map_class *dets = args[0].dets;
+    for(i = 1; i < shards; ++i){
+        for(k = 0; k < classes; ++k){
+            truths[k] += args[i].truths[k];
+            for(j = 0; j < args[i].dets[k].n; ++j){
+                map_add_detection(dets + k, args[i].dets[k].dets[j].prob, args[i].dets[k].dets[j].tp);
+            }
+            free(args[i].dets[k].dets);
+        }
+        free(args[i].truths);
+        free(args[i].dets);
+        free_tta(args[i].tta);
+        free_network(args[i].net);
+    }
+
+    float voc = 0, ap75 = 0, coco = 0;
+    int present = 0;
+    printf("%-20s %8s %8s %8s %8s\n", "class", "truths", "AP50", "AP75", "AP");
+    for(k = 0; k < classes; ++k){
+        qsort(dets[k].dets, dets[k].n, sizeof(map_detection), map_detection_comparator);
+        float ap50 = map_average_precision(dets[k], truths[k], 0, 0);
+        float ap = 0;
+        int t;
+        for(t = 0; t < MAP_IOUS; ++t){
+            ap += map_average_precision(dets[k], truths[k], t, 101);
+        }
+        ap /= MAP_IOUS;
+        float a75 = map_average_precision(dets[k], truths[k], 5, 101);
+        printf("%-20s %8d %8.4f %8.4f %8.4f\n", names[k], truths[k], ap50, a75, ap);
+        if(!truths[k]) continue;
+        voc += ap50;
+        ap75 += a75;
+        coco += ap;
+        ++present;
+    }
+    if(present){
+        voc /= present;
+        ap75 /= present;
+        coco /= present;
+    }
+    printf("mAP@0.50 (VOC): %f\n", voc);
+    printf("mAP@0.75 (COCO): %f\n", ap75);
+    printf("mAP@[.50:.95] (COCO): %f\n", coco);
+    fprintf(stderr, "Total Detection Time: %f Seconds\n", get_wall_time() - start);
+
+    for(k = 0; k < classes; ++k) free(dets[k].dets);
+    free(dets);
+    free(truths);
+    free_tta(args[0].tta);
+    free_network(args[0].net);
+    free(args);
+    free(thr);
+    free(paths);
+    free_list(plist);
+}
+
 void test_detector(char *datacfg, char *cfgfile, char *weightfile, char *filename, float thresh, float hier_thresh, char *outfile, int fullscreen)
 {
     list *options = read_data_cfg(datacfg);
@@ -599,13 +829,14 @@ void test_detector(char *datacfg, char *cfgfile, char *weightfile, char *filenam
     char **names = get_labels(name_list);
 
     image **alphabet = load_alphabet();
-    network net = parse_network_cfg(cfgfile);
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
     if(weightfile){
         load_weights(&net, weightfile);
     }
     set_batch_network(&net, 1);
+    plan_network_memory(&net);
     srand(2222222);
-    clock_t time;
+    double time;
     char buff[256];
     char *input = buff;
     int j;
@@ -629,9 +860,9 @@ void test_detector(char *datacfg, char *cfgfile, char *weightfile, char *filenam
         for(j = 0; j < l.w*l.h*l.n; ++j) probs[j] = calloc(l.classes + 1, sizeof(float *));
 
         float *X = sized.data;
-        time=clock();
+        time=get_wall_time();
         network_predict(net, X);
-        printf("%s: Predicted in %f seconds.\n", input, sec(clock()-time));
+        printf("%s: Predicted in %f seconds.\n", input, get_wall_time()-time);
         get_region_boxes(l, im.w, im.h, net.w, net.h, thresh, probs, boxes, 0, 0, hier_thresh, 1);
         if (nms) do_nms_obj(boxes, probs, l.w*l.h*l.n, l.classes, nms);
         //else if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, l.classes, nms);
@@ -670,7 +901,7 @@ void run_detector(int argc, char **argv)
     int frame_skip = find_int_arg(argc, argv, "-s", 0);
     int avg = find_int_arg(argc, argv, "-avg", 3);
     if(argc < 4){
-        fprintf(stderr, "usage: %s %s [train/test/valid] [cfg] [weights (optional)]\n", argv[0], argv[1]);
+        fprintf(stderr, "usage: %s %s [train/test/valid/map] [cfg] [weights (optional)]\n", argv[0], argv[1]);
         return;
     }
     char *gpu_list = find_char_arg(argc, argv, "-gpus", 0);
@@ -702,6 +933,16 @@ void run_detector(int argc, char **argv)
     int width = find_int_arg(argc, argv, "-w", 0);
     int height = find_int_arg(argc, argv, "-h", 0);
     int fps = find_int_arg(argc, argv, "-fps", 0);
+    int headless = find_arg(argc, argv, "-headless");
+    int batch = find_int_arg(argc, argv, "-batch", 1);
+    int track = find_arg(argc, argv, "-track");
+    int threads = find_int_arg(argc, argv, "-threads", 0);
+    char *ring_peers = find_char_arg(argc, argv, "-ring", 0);
+    int rank = find_int_arg(argc, argv, "-rank", 0);
+#ifndef GPU
+    if(threads > 1) ngpus = threads;
+#endif
+    char *tta = find_char_arg(argc, argv, "-tta", 0);
 
     char *datacfg = argv[3];
     char *cfg = argv[4];
@@ -725,15 +966,17 @@ void run_detector(int argc, char **argv)
     //     printf("here\n");
     //     hot_predict(datacfg, filename, thresh, hier_thresh);
     // }
-    else if(0==strcmp(argv[2], "train")) train_detector(datacfg, cfg, weights, gpus, ngpus, clear);
-    else if(0==strcmp(argv[2], "valid")) validate_detector(datacfg, cfg, weights, outfile);
-    else if(0==strcmp(argv[2], "valid2")) validate_detector_flip(datacfg, cfg, weights, outfile);
+    else if(0==strcmp(argv[2], "train")) train_detector(datacfg, cfg, weights, gpus, ngpus, clear, ring_peers ? make_ring(ring_peers, rank) : 0);
+    else if(0==strcmp(argv[2], "valid")) validate_detector(datacfg, cfg, weights, outfile, tta);
+    else if(0==strcmp(argv[2], "valid2")) validate_detector(datacfg, cfg, weights, outfile, tta ? tta : "1,f1");
     else if(0==strcmp(argv[2], "recall")) validate_detector_recall(datacfg, cfg, weights);
+    else if(0==strcmp(argv[2], "map")) validate_detector_map(datacfg, cfg, weights, threads ? threads : 4, tta);
     else if(0==strcmp(argv[2], "demo")) {
         list *options = read_data_cfg(datacfg);
         int classes = option_find_int(options, "classes", 20);
         char *name_list = option_find_str(options, "names", "data/names.list");
         char **names = get_labels(name_list);
-        demo(cfg, weights, thresh, cam_index, filename, names, classes, frame_skip, prefix, avg, hier_thresh, width, height, fps, fullscreen);
+        if(headless) demo_pipeline(cfg, weights, thresh, hier_thresh, filename, names, classes, prefix, outfile, avg, track, batch, width, height);
+        else demo(cfg, weights, thresh, cam_index, filename, names, classes, frame_skip, prefix, avg, hier_thresh, width, height, fps, fullscreen, track);
     }
 }
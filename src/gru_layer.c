@@ -38,36 +38,36 @@ layer make_gru_layer(int batch, int inputs, int outputs, int steps, int batch_no
 
     l.input_z_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.input_z_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize);
+    *(l.input_z_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize, 1);
     l.input_z_layer->batch = batch;
 
     l.state_z_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.state_z_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize);
+    *(l.state_z_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize, 1);
     l.state_z_layer->batch = batch;
 
 
 
     l.input_r_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.input_r_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize);
+    *(l.input_r_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize, 1);
     l.input_r_layer->batch = batch;
 
     l.state_r_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.state_r_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize);
+    *(l.state_r_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize, 1);
     l.state_r_layer->batch = batch;
 
 
 
     l.input_h_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.input_h_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize);
+    *(l.input_h_layer) = make_connected_layer(batch*steps, inputs, outputs, LINEAR, batch_normalize, 1);
     l.input_h_layer->batch = batch;
 
     l.state_h_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.state_h_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize);
+    *(l.state_h_layer) = make_connected_layer(batch*steps, outputs, outputs, LINEAR, batch_normalize, 1);
     l.state_h_layer->batch = batch;
 
 #ifdef CUDNN
@@ -117,6 +117,57 @@ layer make_gru_layer(int batch, int inputs, int outputs, int steps, int batch_no
     return l;
 }
 
+static void resize_step_layer(layer *s, int batch, int steps)
+{
+    s->batch = batch*steps;
+    resize_connected_layer(s, s->inputs);
+    s->batch = batch;
+}
+
+void resize_gru_layer(layer *l, int inputs)
+{
+    if(inputs != l->inputs) error("GRU layer inputs cannot change size");
+    int batch = l->batch;
+    int outputs = l->outputs;
+    resize_step_layer(l->input_z_layer, batch, l->steps);
+    resize_step_layer(l->state_z_layer, batch, l->steps);
+    resize_step_layer(l->input_r_layer, batch, l->steps);
+    resize_step_layer(l->state_r_layer, batch, l->steps);
+    resize_step_layer(l->input_h_layer, batch, l->steps);
+    resize_step_layer(l->state_h_layer, batch, l->steps);
+
+    l->output = realloc(l->output, outputs*batch*l->steps*sizeof(float));
+    l->delta = realloc(l->delta, outputs*batch*l->steps*sizeof(float));
+    l->state = realloc(l->state, outputs*batch*sizeof(float));
+    l->prev_state = realloc(l->prev_state, outputs*batch*sizeof(float));
+    l->forgot_state = realloc(l->forgot_state, outputs*batch*sizeof(float));
+    l->forgot_delta = realloc(l->forgot_delta, outputs*batch*sizeof(float));
+    l->r_cpu = realloc(l->r_cpu, outputs*batch*sizeof(float));
+    l->z_cpu = realloc(l->z_cpu, outputs*batch*sizeof(float));
+    l->h_cpu = realloc(l->h_cpu, outputs*batch*sizeof(float));
+
+#ifdef GPU
+    cuda_free(l->forgot_state_gpu);
+    cuda_free(l->forgot_delta_gpu);
+    cuda_free(l->prev_state_gpu);
+    cuda_free(l->state_gpu);
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    cuda_free(l->r_gpu);
+    cuda_free(l->z_gpu);
+    cuda_free(l->h_gpu);
+    l->forgot_state_gpu = cuda_make_array(l->output, batch*outputs);
+    l->forgot_delta_gpu = cuda_make_array(l->output, batch*outputs);
+    l->prev_state_gpu = cuda_make_array(l->output, batch*outputs);
+    l->state_gpu = cuda_make_array(l->output, batch*outputs);
+    l->output_gpu = cuda_make_array(l->output, batch*outputs*l->steps);
+    l->delta_gpu = cuda_make_array(l->delta, batch*outputs*l->steps);
+    l->r_gpu = cuda_make_array(l->output_gpu, batch*outputs);
+    l->z_gpu = cuda_make_array(l->output_gpu, batch*outputs);
+    l->h_gpu = cuda_make_array(l->output_gpu, batch*outputs);
+#endif
+}
+
 void update_gru_layer(layer l, int batch, float learning_rate, float momentum, float decay)
 {
     update_connected_layer(*(l.input_layer), batch, learning_rate, momentum, decay);
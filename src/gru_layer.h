@@ -11,6 +11,7 @@ layer make_gru_layer(int batch, int inputs, int outputs, int steps, int batch_no
 void forward_gru_layer(layer l, network net);
 void backward_gru_layer(layer l, network net);
 void update_gru_layer(layer l, int batch, float learning_rate, float momentum, float decay);
+void resize_gru_layer(layer *l, int inputs);
 
 #ifdef GPU
 void forward_gru_layer_gpu(layer l, network net);
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "half.h"
+#include "mapped_weights.h"
+#include "gemm.h"
+#include "utils.h"
+
+/* Weight rows converted to fp32 per GEMM call. */
+#define HALF_PANEL 16
+
+half_type get_half_type(char *s)
+{
+    if(strcmp(s, "fp16") == 0) return HALF_FP16;
+    if(strcmp(s, "bf16") == 0) return HALF_BF16;
+    fprintf(stderr, "Unknown half precision type %s, use fp16 or bf16\n", s);
+    error("Bad half precision type");
+    return HALF_NONE;
+}
+
+static uint16_t fp16_from_float(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mant = x & 0x7fffff;
+    int exp = (x >> 23) & 0xff;
+    if(exp == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);
+    exp = exp - 127 + 15;
+    if(exp >= 0x1f) return sign | 0x7c00;
+    if(exp <= 0){
+        if(exp < -10) return sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if(rem > half || (rem == half && (h & 1))) ++h;
+        return sign | h;
+    }
+    uint32_t h = (exp << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fff;
+    if(rem > 0x1000 || (rem == 0x1000 && (h & 1))) ++h;
+    return sign | h;
+}
+
+static float fp16_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+    if(exp == 0x1f){
+        x = sign | 0x7f800000 | (mant << 13);
+    } else if(exp){
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if(mant){
+        exp = 113;
+        while(!(mant & 0x400)){
+            mant <<= 1;
+            --exp;
+        }
+        x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    } else {
+        x = sign;
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static uint16_t bf16_from_float(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if((x & 0x7fffffff) > 0x7f800000) return (x >> 16) | 0x40;
+    x += 0x7fff + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+void float_to_half(float *f, uint16_t *h, size_t n, half_type type)
+{
+    size_t i;
+    for(i = 0; i < n; ++i){
+        h[i] = (type == HALF_BF16) ? bf16_from_float(f[i]) : fp16_from_float(f[i]);
+    }
+}
+
+void half_to_float(uint16_t *h, float *f, size_t n, half_type type)
+{
+    size_t i = 0;
+    if(type == HALF_BF16){
+#ifdef __AVX2__
+        for(; i + 8 <= n; i += 8){
+            __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *)(h + i)));
+            _mm256_storeu_ps(f + i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+        }
+#endif
+        for(; i < n; ++i){
+            uint32_t x = (uint32_t)h[i] << 16;
+            memcpy(f + i, &x, sizeof(x));
+        }
+        return;
+    }
+#ifdef __F16C__
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(f + i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i *)(h + i))));
+    }
+#endif
+    for(; i < n; ++i) f[i] = fp16_to_float(h[i]);
+}
+
+static int half_cols(layer l)
+{
+    return l.type == CONNECTED ? l.inputs : l.size*l.size*l.c;
+}
+
+/* Convolutions keep their im2col buffer in front of the panel. */
+size_t half_workspace_size(layer l)
+{
+    size_t panel = (size_t)HALF_PANEL*half_cols(l);
+    if(l.type == CONNECTED) return panel*sizeof(float);
+    return ((size_t)l.out_h*l.out_w*half_cols(l) + panel)*sizeof(float);
+}
+
+void enable_half_layer(network *net, layer *l, half_type type)
+{
+    if(l->type != CONVOLUTIONAL && l->type != CONNECTED) error("Only convolutional and connected layers can store half precision weights");
+    if(l->binary || l->xnor) error("Binary layers can not store half precision weights");
+    if(l->type == CONVOLUTIONAL && l->groups > 1) error("Grouped convolutions can not store half precision weights");
+#ifdef GPU
+    if(gpu_index >= 0) error("Half precision weights are CPU only");
+#endif
+    if(!is_mapped_pointer(net, l->weights)) free(l->weights);
+    l->weights = 0;
+    l->half = type;
+    reserve_layer_workspace(net, l, half_workspace_size(*l));
+}
+
+void convert_layer_to_half(network *net, layer *l, half_type type)
+{
+    size_t n = (size_t)(l->type == CONNECTED ? l->outputs : l->n)*half_cols(*l);
+    uint16_t *h = calloc(n, sizeof(uint16_t));
+    float_to_half(l->weights, h, n, type);
+    enable_half_layer(net, l, type);
+    l->half_weights = h;
+}
+
+/* C += A*B with A stored in half precision, upconverted a panel of rows at a time. */
+void gemm_half_nn(int M, int N, int K, uint16_t *A, half_type type, float *B, float *C, float *panel)
+{
+    int i;
+    for(i = 0; i < M; i += HALF_PANEL){
+        int rows = (M - i < HALF_PANEL) ? M - i : HALF_PANEL;
+        half_to_float(A + (size_t)i*K, panel, (size_t)rows*K, type);
+        gemm(0,0,rows,N,K,1,panel,K,B,N,1,C + (size_t)i*N,N);
+    }
+}
+
+/* C += A*B' with B stored in half precision. */
+void gemm_half_nt(int M, int N, int K, float *A, uint16_t *B, half_type type, float *C, float *panel)
+{
+    int j;
+    for(j = 0; j < N; j += HALF_PANEL){
+        int cols = (N - j < HALF_PANEL) ? N - j : HALF_PANEL;
+        half_to_float(B + (size_t)j*K, panel, (size_t)cols*K, type);
+        gemm(0,1,M,cols,K,1,A,K,panel,K,1,C + j,N);
+    }
+}
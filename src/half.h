@@ -0,0 +1,19 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include "network.h"
+
+typedef enum{
+    HALF_NONE, HALF_FP16, HALF_BF16
+} half_type;
+
+half_type get_half_type(char *s);
+void float_to_half(float *f, uint16_t *h, size_t n, half_type type);
+void half_to_float(uint16_t *h, float *f, size_t n, half_type type);
+size_t half_workspace_size(layer l);
+void enable_half_layer(network *net, layer *l, half_type type);
+void convert_layer_to_half(network *net, layer *l, half_type type);
+void gemm_half_nn(int M, int N, int K, uint16_t *A, half_type type, float *B, float *C, float *panel);
+void gemm_half_nt(int M, int N, int K, float *A, uint16_t *B, half_type type, float *C, float *panel);
+
+#endif
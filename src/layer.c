@@ -12,6 +12,12 @@ void free_layer(layer l)
         return;
     }
     if(l.cweights)           free(l.cweights);
+    if(l.qweights)           free(l.qweights);
+    if(l.qscales)            free(l.qscales);
+    if(l.bit_weights)        free(l.bit_weights);
+    if(l.bit_scales)         free(l.bit_scales);
+    if(l.half_weights)       free(l.half_weights);
+    if(l.winograd_weights)   free(l.winograd_weights);
     if(l.indexes)            free(l.indexes);
     if(l.input_layers)       free(l.input_layers);
     if(l.input_sizes)        free(l.input_sizes);
@@ -33,7 +39,7 @@ void free_layer(layer l)
     if(l.weights)            free(l.weights);
     if(l.weight_updates)     free(l.weight_updates);
     if(l.delta)              free(l.delta);
-    if(l.output)             free(l.output);
+    if(l.output && !l.output_view) free(l.output);
     if(l.squared)            free(l.squared);
     if(l.norms)              free(l.norms);
     if(l.spatial_mean)       free(l.spatial_mean);
@@ -3,6 +3,7 @@
 
 #include "activations.h"
 #include "stddef.h"
+#include <stdint.h>
 #include "tree.h"
 
 struct network;
@@ -78,6 +79,11 @@ struct layer{
     int flip;
     int index;
     int binary;
+    int quantized;
+    int bitpacked;
+    int half;
+    int winograd;
+    int output_view;
     int xnor;
     int steps;
     int hidden;
@@ -133,6 +139,12 @@ struct layer{
     float scale;
 
     char  * cweights;
+    signed char * qweights;
+    float * qscales;
+    uint64_t * bit_weights;
+    float * bit_scales;
+    uint16_t * half_weights;
+    float * winograd_weights;
     int   * indexes;
     int   * input_layers;
     int   * input_sizes;
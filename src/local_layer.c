@@ -23,6 +23,16 @@ int local_out_width(local_layer l)
     return w/l.stride + 1;
 }
 
+/* The GPU im2cols every location at once; the CPU holds the patches, input deltas and
+   output deltas of one location for the whole batch. */
+static size_t local_workspace_size(local_layer l)
+{
+    size_t k = l.size*l.size*l.c;
+    size_t gpu = (size_t)l.out_h*l.out_w*k;
+    size_t cpu = 2*l.batch*k + (size_t)l.n*l.batch;
+    return (gpu > cpu ? gpu : cpu)*sizeof(float);
+}
+
 local_layer make_local_layer(int batch, int h, int w, int c, int n, int size, int stride, int pad, ACTIVATION activation)
 {
     int i;
@@ -60,7 +70,7 @@ local_layer make_local_layer(int batch, int h, int w, int c, int n, int size, in
     l.output = calloc(l.batch*out_h * out_w * n, sizeof(float));
     l.delta  = calloc(l.batch*out_h * out_w * n, sizeof(float));
 
-    l.workspace_size = out_h*out_w*size*size*c;
+    l.workspace_size = local_workspace_size(l);
     
     l.forward = forward_local_layer;
     l.backward = backward_local_layer;
@@ -88,32 +98,78 @@ local_layer make_local_layer(int batch, int h, int w, int c, int n, int size, in
     return l;
 }
 
-void forward_local_layer(const local_layer l, network net)
+void resize_local_layer(local_layer *l, int w, int h)
 {
-    int out_h = local_out_height(l);
-    int out_w = local_out_width(l);
-    int i, j;
-    int locations = out_h * out_w;
+    if(w != l->w || h != l->h) error("Local layer weights are tied to its input size");
+    l->output = realloc(l->output, l->batch*l->outputs*sizeof(float));
+    l->delta  = realloc(l->delta,  l->batch*l->outputs*sizeof(float));
+    l->workspace_size = local_workspace_size(*l);
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    l->output_gpu = cuda_make_array(l->output, l->batch*l->outputs);
+    l->delta_gpu = cuda_make_array(l->delta, l->batch*l->outputs);
+#endif
+}
 
-    for(i = 0; i < l.batch; ++i){
-        copy_cpu(l.outputs, l.biases, 1, l.output + i*l.outputs, 1);
+/* patches[b][k] is the im2col column of location (x, y) for every image in the batch, so each
+   location's weights multiply contiguous rows. */
+static void gather_local_patches(local_layer l, float *input, int x, int y, float *patches)
+{
+    int b, c, i, j;
+    int k = l.size*l.size*l.c;
+    for(b = 0; b < l.batch; ++b){
+        float *patch = patches + b*k;
+        for(c = 0; c < l.c; ++c){
+            float *im = input + (b*l.c + c)*l.h*l.w;
+            for(i = 0; i < l.size; ++i){
+                int iy = y*l.stride + i - l.pad;
+                for(j = 0; j < l.size; ++j){
+                    int ix = x*l.stride + j - l.pad;
+                    *patch++ = (iy >= 0 && iy < l.h && ix >= 0 && ix < l.w) ? im[iy*l.w + ix] : 0;
+                }
+            }
+        }
     }
+}
 
-    for(i = 0; i < l.batch; ++i){
-        float *input = net.input + i*l.w*l.h*l.c;
-        im2col_cpu(input, l.c, l.h, l.w, 
-                l.size, l.stride, l.pad, net.workspace);
-        float *output = l.output + i*l.outputs;
-        for(j = 0; j < locations; ++j){
-            float *a = l.weights + j*l.size*l.size*l.c*l.n;
-            float *b = net.workspace + j;
-            float *c = output + j;
-
-            int m = l.n;
-            int n = 1;
-            int k = l.size*l.size*l.c;
+static void scatter_local_patches(local_layer l, float *patches, int x, int y, float *delta)
+{
+    int b, c, i, j;
+    int k = l.size*l.size*l.c;
+    for(b = 0; b < l.batch; ++b){
+        float *patch = patches + b*k;
+        for(c = 0; c < l.c; ++c){
+            float *im = delta + (b*l.c + c)*l.h*l.w;
+            for(i = 0; i < l.size; ++i){
+                int iy = y*l.stride + i - l.pad;
+                for(j = 0; j < l.size; ++j, ++patch){
+                    int ix = x*l.stride + j - l.pad;
+                    if(iy >= 0 && iy < l.h && ix >= 0 && ix < l.w) im[iy*l.w + ix] += *patch;
+                }
+            }
+        }
+    }
+}
 
-            gemm(0,0,m,n,k,1,a,k,b,locations,1,c,locations);
+void forward_local_layer(const local_layer l, network net)
+{
+    int b, f, x, y;
+    int locations = l.out_w*l.out_h;
+    int k = l.size*l.size*l.c;
+    float *patches = net.workspace;
+    float *out = patches + l.batch*k;
+
+    for(y = 0; y < l.out_h; ++y){
+        for(x = 0; x < l.out_w; ++x){
+            int j = y*l.out_w + x;
+            gather_local_patches(l, net.input, x, y, patches);
+            gemm(0,1,l.n,l.batch,k,1,l.weights + j*k*l.n,k,patches,k,0,out,l.batch);
+            for(f = 0; f < l.n; ++f){
+                for(b = 0; b < l.batch; ++b){
+                    l.output[b*l.outputs + f*locations + j] = out[f*l.batch + b] + l.biases[f*locations + j];
+                }
+            }
         }
     }
     activate_array(l.output, l.outputs*l.batch, l.activation);
@@ -121,45 +177,34 @@ void forward_local_layer(const local_layer l, network net)
 
 void backward_local_layer(local_layer l, network net)
 {
-    int i, j;
+    int b, f, x, y;
     int locations = l.out_w*l.out_h;
+    int k = l.size*l.size*l.c;
+    float *patches = net.workspace;
+    float *grads = patches + l.batch*k;
+    float *delta = grads + l.batch*k;
 
     gradient_array(l.output, l.outputs*l.batch, l.activation, l.delta);
 
-    for(i = 0; i < l.batch; ++i){
-        axpy_cpu(l.outputs, 1, l.delta + i*l.outputs, 1, l.bias_updates, 1);
+    for(b = 0; b < l.batch; ++b){
+        axpy_cpu(l.outputs, 1, l.delta + b*l.outputs, 1, l.bias_updates, 1);
     }
 
-    for(i = 0; i < l.batch; ++i){
-        float *input = net.input + i*l.w*l.h*l.c;
-        im2col_cpu(input, l.c, l.h, l.w, 
-                l.size, l.stride, l.pad, net.workspace);
-
-        for(j = 0; j < locations; ++j){ 
-            float *a = l.delta + i*l.outputs + j;
-            float *b = net.workspace + j;
-            float *c = l.weight_updates + j*l.size*l.size*l.c*l.n;
-            int m = l.n;
-            int n = l.size*l.size*l.c;
-            int k = 1;
-
-            gemm(0,1,m,n,k,1,a,locations,b,locations,1,c,n);
-        }
-
-        if(net.delta){
-            for(j = 0; j < locations; ++j){ 
-                float *a = l.weights + j*l.size*l.size*l.c*l.n;
-                float *b = l.delta + i*l.outputs + j;
-                float *c = net.workspace + j;
-
-                int m = l.size*l.size*l.c;
-                int n = 1;
-                int k = l.n;
-
-                gemm(1,0,m,n,k,1,a,m,b,locations,0,c,locations);
+    for(y = 0; y < l.out_h; ++y){
+        for(x = 0; x < l.out_w; ++x){
+            int j = y*l.out_w + x;
+            for(f = 0; f < l.n; ++f){
+                for(b = 0; b < l.batch; ++b){
+                    delta[f*l.batch + b] = l.delta[b*l.outputs + f*locations + j];
+                }
             }
+            gather_local_patches(l, net.input, x, y, patches);
+            gemm(0,0,l.n,k,l.batch,1,delta,l.batch,patches,k,1,l.weight_updates + j*k*l.n,k);
 
-            col2im_cpu(net.workspace, l.c,  l.h,  l.w,  l.size,  l.stride, l.pad, net.delta+i*l.c*l.h*l.w);
+            if(net.delta){
+                gemm(1,0,l.batch,k,l.n,1,delta,l.batch,l.weights + j*k*l.n,k,0,grads,k);
+                scatter_local_patches(l, grads, x, y, net.delta);
+            }
         }
     }
 }
@@ -23,6 +23,7 @@ local_layer make_local_layer(int batch, int h, int w, int c, int n, int size, in
 void forward_local_layer(const local_layer layer, network net);
 void backward_local_layer(local_layer layer, network net);
 void update_local_layer(local_layer layer, int batch, float learning_rate, float momentum, float decay);
+void resize_local_layer(local_layer *l, int w, int h);
 
 void bias_output(float *output, float *biases, int batch, int n, int size);
 void backward_bias(float *bias_updates, float *delta, int batch, int n, int size);
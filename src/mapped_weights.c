@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapped_weights.h"
+#include "batchnorm_layer.h"
+#include "connected_layer.h"
+#include "convolutional_layer.h"
+#include "local_layer.h"
+#include "quantize.h"
+#include "bitpack.h"
+#include "half.h"
+#include "cuda.h"
+#include "utils.h"
+
+#define MAX_TENSORS 6
+
+static int sub_layers(layer l)
+{
+    if(l.type == RNN || l.type == CRNN) return 3;
+    if(l.type == GRU) return 6;
+    return 1;
+}
+
+static layer *sub_layer(layer *l, int sub)
+{
+    if(l->type == RNN || l->type == CRNN){
+        layer *subs[] = {l->input_layer, l->self_layer, l->output_layer};
+        return subs[sub];
+    }
+    if(l->type == GRU){
+        layer *subs[] = {l->input_z_layer, l->input_r_layer, l->input_h_layer,
+                         l->state_z_layer, l->state_r_layer, l->state_h_layer};
+        return subs[sub];
+    }
+    return l;
+}
+
+typedef struct{
+    void **ptr;
+    int kind;
+    int dtype;
+    size_t count;
+} layer_tensor;
+
+static int add_tensor(layer_tensor *t, int n, void *p, int kind, int dtype, size_t count)
+{
+    t[n].ptr = p;
+    t[n].kind = kind;
+    t[n].dtype = dtype;
+    t[n].count = count;
+    return n + 1;
+}
+
+static size_t tensor_bytes(int dtype, size_t count)
+{
+    if(dtype == DTYPE_B1) return count/8;
+    if(dtype == DTYPE_I8) return count;
+    if(dtype == DTYPE_F16 || dtype == DTYPE_BF16) return count*sizeof(uint16_t);
+    return count*sizeof(float);
+}
+
+static int add_weights(layer_tensor *t, int n, layer *l, size_t count)
+{
+    if(l->half) return add_tensor(t, n, &l->half_weights, TENSOR_WEIGHTS, l->half == HALF_BF16 ? DTYPE_BF16 : DTYPE_F16, count);
+    return add_tensor(t, n, &l->weights, TENSOR_WEIGHTS, DTYPE_F32, count);
+}
+
+/* Tensors in the same order the legacy format stores them. */
+static int layer_tensors(layer *l, layer_tensor *t)
+{
+    int n = 0;
+    if(l->quantized){
+        int rows = l->type == CONNECTED ? l->outputs : l->n;
+        int k = l->type == CONNECTED ? l->inputs : l->size*l->size*l->c;
+        n = add_tensor(t, n, &l->biases, TENSOR_BIASES, DTYPE_F32, rows);
+        n = add_tensor(t, n, &l->qscales, TENSOR_QUANT_SCALES, DTYPE_F32, rows + 1);
+        n = add_tensor(t, n, &l->qweights, TENSOR_WEIGHTS, DTYPE_I8, (size_t)rows*quantized_row_size(k));
+    } else if(l->bitpacked){
+        n = add_tensor(t, n, &l->biases, TENSOR_BIASES, DTYPE_F32, l->n);
+        if(l->batch_normalize){
+            n = add_tensor(t, n, &l->scales, TENSOR_SCALES, DTYPE_F32, l->n);
+            n = add_tensor(t, n, &l->rolling_mean, TENSOR_ROLLING_MEAN, DTYPE_F32, l->n);
+            n = add_tensor(t, n, &l->rolling_variance, TENSOR_ROLLING_VARIANCE, DTYPE_F32, l->n);
+        }
+        n = add_tensor(t, n, &l->bit_scales, TENSOR_BINARY_SCALES, DTYPE_F32, l->n);
+        n = add_tensor(t, n, &l->bit_weights, TENSOR_WEIGHTS, DTYPE_B1, (size_t)l->n*bitpack_words(l->size*l->size*l->c)*64);
+    } else if(l->type == CONVOLUTIONAL || l->type == DECONVOLUTIONAL){
+        n = add_tensor(t, n, &l->biases, TENSOR_BIASES, DTYPE_F32, l->n);
+        if(l->batch_normalize){
+            n = add_tensor(t, n, &l->scales, TENSOR_SCALES, DTYPE_F32, l->n);
+            n = add_tensor(t, n, &l->rolling_mean, TENSOR_ROLLING_MEAN, DTYPE_F32, l->n);
+            n = add_tensor(t, n, &l->rolling_variance, TENSOR_ROLLING_VARIANCE, DTYPE_F32, l->n);
+        }
+        n = add_weights(t, n, l, l->nweights);
+    } else if(l->type == CONNECTED){
+        n = add_tensor(t, n, &l->biases, TENSOR_BIASES, DTYPE_F32, l->outputs);
+        n = add_weights(t, n, l, (size_t)l->outputs*l->inputs);
+        if(l->batch_normalize){
+            n = add_tensor(t, n, &l->scales, TENSOR_SCALES, DTYPE_F32, l->outputs);
+            n = add_tensor(t, n, &l->rolling_mean, TENSOR_ROLLING_MEAN, DTYPE_F32, l->outputs);
+            n = add_tensor(t, n, &l->rolling_variance, TENSOR_ROLLING_VARIANCE, DTYPE_F32, l->outputs);
+        }
+    } else if(l->type == BATCHNORM){
+        n = add_tensor(t, n, &l->scales, TENSOR_SCALES, DTYPE_F32, l->c);
+        n = add_tensor(t, n, &l->rolling_mean, TENSOR_ROLLING_MEAN, DTYPE_F32, l->c);
+        n = add_tensor(t, n, &l->rolling_variance, TENSOR_ROLLING_VARIANCE, DTYPE_F32, l->c);
+    } else if(l->type == LOCAL){
+        int locations = l->out_w*l->out_h;
+        n = add_tensor(t, n, &l->biases, TENSOR_BIASES, DTYPE_F32, l->outputs);
+        n = add_tensor(t, n, &l->weights, TENSOR_WEIGHTS, DTYPE_F32, (size_t)l->size*l->size*l->c*l->n*locations);
+    }
+    return n;
+}
+
+/* Layers built for training update their parameters in place, so they get a private copy. */
+static int writable_layer(layer *l)
+{
+    if(l->type == BATCHNORM) return l->scale_updates != 0;
+    return l->weight_updates != 0;
+}
+
+#ifdef GPU
+static void push_mapped_layer(layer *l)
+{
+    if(l->type == CONVOLUTIONAL) push_convolutional_layer(*l);
+    if(l->type == CONNECTED) push_connected_layer(*l);
+    if(l->type == BATCHNORM) push_batchnorm_layer(*l);
+    if(l->type == LOCAL) push_local_layer(*l);
+}
+
+static void pull_mapped_layer(layer *l)
+{
+    if(l->type == CONVOLUTIONAL) pull_convolutional_layer(*l);
+    if(l->type == CONNECTED) pull_connected_layer(*l);
+    if(l->type == BATCHNORM) pull_batchnorm_layer(*l);
+    if(l->type == LOCAL) pull_local_layer(*l);
+}
+#endif
+
+static size_t align_offset(size_t offset)
+{
+    return (offset + MAPPED_WEIGHTS_ALIGN - 1) / MAPPED_WEIGHTS_ALIGN * MAPPED_WEIGHTS_ALIGN;
+}
+
+int is_mapped_pointer(network *net, void *p)
+{
+    char *base = net->mapped;
+    return base && (char *)p >= base && (char *)p < base + net->mapped_size;
+}
+
+int is_mapped_weights(char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if(!fp) return 0;
+    int32_t magic = 0;
+    int ok = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == MAPPED_WEIGHTS_MAGIC;
+    fclose(fp);
+    return ok;
+}
+
+void save_mapped_weights(network net, char *filename)
+{
+    int i, s, t;
+    layer_tensor tensors[MAX_TENSORS];
+
+    int ntensors = 0;
+    for(i = 0; i < net.n; ++i){
+        for(s = 0; s < sub_layers(net.layers[i]); ++s){
+            layer *l = sub_layer(net.layers + i, s);
+#ifdef GPU
+            if(net.gpu_index >= 0) pull_mapped_layer(l);
+#endif
+            ntensors += layer_tensors(l, tensors);
+        }
+    }
+
+    fprintf(stderr, "Saving mapped weights to %s\n", filename);
+    FILE *fp = fopen(filename, "wb");
+    if(!fp) file_error(filename);
+
+    mapped_header h = {0};
+    h.magic = MAPPED_WEIGHTS_MAGIC;
+    h.version = MAPPED_WEIGHTS_VERSION;
+    h.nlayers = net.n;
+    h.ntensors = ntensors;
+    h.seen = *net.seen;
+
+    mapped_tensor *table = calloc(ntensors, sizeof(mapped_tensor));
+    size_t offset = align_offset(sizeof(h) + ntensors*sizeof(mapped_tensor));
+    int k = 0;
+    for(i = 0; i < net.n; ++i){
+        for(s = 0; s < sub_layers(net.layers[i]); ++s){
+            int n = layer_tensors(sub_layer(net.layers + i, s), tensors);
+            for(t = 0; t < n; ++t, ++k){
+                table[k].layer = i;
+                table[k].sub = s;
+                table[k].kind = tensors[t].kind;
+                table[k].dtype = tensors[t].dtype;
+                table[k].count = tensors[t].count;
+                table[k].offset = offset;
+                offset = align_offset(offset + tensor_bytes(tensors[t].dtype, tensors[t].count));
+            }
+        }
+    }
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(table, sizeof(mapped_tensor), ntensors, fp);
+
+    char pad[MAPPED_WEIGHTS_ALIGN] = {0};
+    k = 0;
+    for(i = 0; i < net.n; ++i){
+        for(s = 0; s < sub_layers(net.layers[i]); ++s){
+            int n = layer_tensors(sub_layer(net.layers + i, s), tensors);
+            for(t = 0; t < n; ++t, ++k){
+                long pos = ftell(fp);
+                fwrite(pad, 1, table[k].offset - pos, fp);
+                fwrite(*tensors[t].ptr, 1, tensor_bytes(tensors[t].dtype, tensors[t].count), fp);
+            }
+        }
+    }
+    free(table);
+    fclose(fp);
+}
+
+void load_mapped_weights_upto(network *net, char *filename, int start, int cutoff)
+{
+    int i, t;
+    if(net->mapped) error("Network already has mapped weights");
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) file_error(filename);
+    struct stat st;
+    if(fstat(fd, &st) < 0) file_error(filename);
+    size_t size = st.st_size;
+    if(size < sizeof(mapped_header)) error("Truncated mapped weights file");
+    char *base = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) file_error(filename);
+
+    mapped_header h = *(mapped_header *)base;
+    if(h.magic != MAPPED_WEIGHTS_MAGIC) error("Not a mapped weights file");
+    if(h.version != MAPPED_WEIGHTS_VERSION) error("Unsupported mapped weights version");
+    if(h.nlayers != net->n) error("Mapped weights do not match the network");
+    if(sizeof(h) + h.ntensors*sizeof(mapped_tensor) > size) error("Truncated mapped weights file");
+    *net->seen = h.seen;
+
+    mapped_tensor *table = (mapped_tensor *)(base + sizeof(h));
+    layer_tensor tensors[MAX_TENSORS];
+    int shared = 0;
+    for(i = 0; i < h.ntensors; ++i){
+        mapped_tensor e = table[i];
+        int quantized = e.kind == TENSOR_QUANT_SCALES;
+        int bitpacked = e.kind == TENSOR_BINARY_SCALES;
+        int half = e.kind == TENSOR_WEIGHTS && (e.dtype == DTYPE_F16 || e.dtype == DTYPE_BF16);
+        if(!(quantized || bitpacked || half) || e.layer < start || e.layer >= cutoff) continue;
+        layer *top = net->layers + e.layer;
+        if(top->dontload || e.sub >= sub_layers(*top)) continue;
+        layer *l = sub_layer(top, e.sub);
+        if(writable_layer(l)) error("Reduced precision weights can only be loaded for inference");
+        if(quantized && !l->quantized) enable_quantized_layer(net, l);
+        if(bitpacked && !l->bitpacked) enable_bitpacked_layer(net, l);
+        if(half && !l->half) enable_half_layer(net, l, e.dtype == DTYPE_BF16 ? HALF_BF16 : HALF_FP16);
+    }
+    for(i = 0; i < h.ntensors; ++i){
+        mapped_tensor e = table[i];
+        if(e.layer < start || e.layer >= cutoff) continue;
+        layer *top = net->layers + e.layer;
+        if(top->dontload) continue;
+        if(e.sub >= sub_layers(*top)) error("Mapped weights do not match the network");
+        layer *l = sub_layer(top, e.sub);
+        int n = layer_tensors(l, tensors);
+        for(t = 0; t < n; ++t) if(tensors[t].kind == e.kind) break;
+        if(t == n || tensors[t].count != e.count) error("Mapped weights do not match the network");
+        if(e.dtype != tensors[t].dtype) error("Unsupported mapped tensor type");
+        size_t bytes = tensor_bytes(e.dtype, e.count);
+        if(e.offset % MAPPED_WEIGHTS_ALIGN || e.offset + bytes > size) error("Corrupt mapped weights file");
+        if(l->dontloadscales && e.kind != TENSOR_BIASES && e.kind != TENSOR_WEIGHTS) continue;
+
+        void *src = base + e.offset;
+        if(writable_layer(l)){
+            memcpy(*tensors[t].ptr, src, bytes);
+        } else {
+            free(*tensors[t].ptr);
+            *tensors[t].ptr = src;
+            ++shared;
+        }
+    }
+#ifdef GPU
+    if(gpu_index >= 0){
+        int s;
+        for(i = start; i < net->n && i < cutoff; ++i){
+            for(s = 0; s < sub_layers(net->layers[i]); ++s) push_mapped_layer(sub_layer(net->layers + i, s));
+        }
+    }
+#endif
+    if(shared){
+        net->mapped = base;
+        net->mapped_size = size;
+    } else {
+        munmap(base, size);
+    }
+}
+
+void release_mapped_weights(network *net)
+{
+    int i, s, t;
+    if(!net->mapped) return;
+    char *base = net->mapped;
+    layer_tensor tensors[MAX_TENSORS];
+    for(i = 0; i < net->n; ++i){
+        for(s = 0; s < sub_layers(net->layers[i]); ++s){
+            int n = layer_tensors(sub_layer(net->layers + i, s), tensors);
+            for(t = 0; t < n; ++t){
+                char *p = *tensors[t].ptr;
+                if(p >= base && p < base + net->mapped_size) *tensors[t].ptr = 0;
+            }
+        }
+    }
+    munmap(net->mapped, net->mapped_size);
+    net->mapped = 0;
+    net->mapped_size = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef MAPPED_WEIGHTS_H
+#define MAPPED_WEIGHTS_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define MAPPED_WEIGHTS_MAGIC 0x4d574b44 /* "DKWM" */
+#define MAPPED_WEIGHTS_VERSION 1
+#define MAPPED_WEIGHTS_ALIGN 64
+
+/* TENSOR_QUANT_SCALES holds the calibrated input scale followed by one scale per output;
+   TENSOR_BINARY_SCALES the mean magnitude of each bit-packed filter. */
+typedef enum{
+    TENSOR_BIASES, TENSOR_SCALES, TENSOR_ROLLING_MEAN, TENSOR_ROLLING_VARIANCE, TENSOR_WEIGHTS,
+    TENSOR_QUANT_SCALES, TENSOR_BINARY_SCALES
+} tensor_kind;
+
+typedef enum{
+    DTYPE_F32, DTYPE_I8, DTYPE_B1, DTYPE_F16, DTYPE_BF16
+} tensor_dtype;
+
+typedef struct{
+    int32_t magic;
+    int32_t version;
+    int32_t nlayers;
+    int32_t ntensors;
+    int32_t seen;
+    int32_t reserved[11];
+} mapped_header;
+
+typedef struct{
+    int32_t layer;
+    int32_t sub;
+    int32_t kind;
+    int32_t dtype;
+    uint64_t count;
+    uint64_t offset;
+} mapped_tensor;
+
+int is_mapped_weights(char *filename);
+int is_mapped_pointer(network *net, void *p);
+void save_mapped_weights(network net, char *filename);
+void load_mapped_weights_upto(network *net, char *filename, int start, int cutoff);
+void release_mapped_weights(network *net);
+
+#endif
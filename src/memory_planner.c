@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "memory_planner.h"
+#include "route_layer.h"
+#include "utils.h"
+
+static int plannable_layer(layer l)
+{
+    switch(l.type){
+        case CONVOLUTIONAL:
+        case DECONVOLUTIONAL:
+        case CONNECTED:
+        case LOCAL:
+        case MAXPOOL:
+        case AVGPOOL:
+        case ROUTE:
+        case SHORTCUT:
+        case REORG:
+        case ACTIVE:
+        case BATCHNORM:
+        case NORMALIZATION:
+        case SOFTMAX:
+        case CROP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int planned_output(network net, int i)
+{
+    int j;
+    if(net.layers[i].output_view) return 0;
+    for(j = 0; j < net.narenas; ++j){
+        if(net.layers[i].output == net.arenas[j]) return 1;
+    }
+    return 0;
+}
+
+static void use_buffer(int *last_use, int *buf, int producer, int consumer)
+{
+    if(producer < 0) return;
+    int b = buf[producer];
+    if(last_use[b] < consumer) last_use[b] = consumer;
+}
+
+void plan_network_memory(network *net)
+{
+    int i, j, k;
+    if(net->narenas) unplan_network_memory(net);
+
+    int n = net->n;
+    int *buf = calloc(n, sizeof(int));
+    int *last_use = calloc(n, sizeof(int));
+    int *arena_of = calloc(n, sizeof(int));
+    for(i = 0; i < n; ++i){
+        buf[i] = i;
+        last_use[i] = i;
+    }
+    for(i = n-1; i >= 0; --i){
+        if(net->layers[i].output_view) buf[i] = buf[route_output_owner(net, i)];
+    }
+    for(i = 1; i < n; ++i){
+        if(net->layers[i].type == DROPOUT) buf[i] = buf[i-1];
+    }
+    for(i = 0; i < n; ++i){
+        layer l = net->layers[i];
+        use_buffer(last_use, buf, i-1, i);
+        if(l.type == ROUTE){
+            for(j = 0; j < l.n; ++j) use_buffer(last_use, buf, l.input_layers[j], i);
+        }
+        if(l.type == SHORTCUT) use_buffer(last_use, buf, l.index, i);
+    }
+    layer out = get_network_output_layer(*net);
+    for(i = 0; i < n; ++i){
+        if(i == n-1 || net->layers[i].output == out.output) last_use[buf[i]] = n;
+    }
+
+    size_t *size = calloc(n, sizeof(size_t));
+    int *busy_until = calloc(n, sizeof(int));
+    int narenas = 0;
+    size_t before = 0;
+    for(i = 0; i < n; ++i) arena_of[i] = -1;
+    /* Buffers are placed when first written, which for a route is its first view producer. */
+    for(i = 0; i < n; ++i){
+        int b = buf[i];
+        layer l = net->layers[b];
+        if(arena_of[b] >= 0 || !plannable_layer(l) || last_use[b] == n) continue;
+        size_t need = (size_t)l.outputs*l.batch;
+        before += need;
+        int best = -1;
+        for(k = 0; k < narenas; ++k){
+            if(busy_until[k] >= i) continue;
+            if(best < 0){
+                best = k;
+            } else if(size[best] < need){
+                if(size[k] > size[best]) best = k;
+            } else if(size[k] >= need && size[k] < size[best]){
+                best = k;
+            }
+        }
+        if(best < 0) best = narenas++;
+        if(size[best] < need) size[best] = need;
+        busy_until[best] = last_use[b];
+        arena_of[b] = best;
+    }
+
+    size_t after = 0;
+    net->arenas = calloc(narenas, sizeof(float *));
+    net->narenas = narenas;
+    for(k = 0; k < narenas; ++k){
+        net->arenas[k] = calloc(size[k], sizeof(float));
+        after += size[k];
+    }
+    for(i = 0; i < n; ++i){
+        layer *l = net->layers + i;
+        if(arena_of[i] >= 0){
+            free(l->output);
+            l->output = net->arenas[arena_of[i]];
+        } else if(l->type == DROPOUT && i > 0){
+            l->output = net->layers[i-1].output;
+        }
+    }
+    link_route_outputs(net);
+    fprintf(stderr, "Planned activations: %.1f MB -> %.1f MB in %d arenas\n",
+            before*sizeof(float)/1e6, after*sizeof(float)/1e6, narenas);
+
+    free(buf);
+    free(last_use);
+    free(arena_of);
+    free(size);
+    free(busy_until);
+}
+
+void unplan_network_memory(network *net)
+{
+    int i, k;
+    if(!net->narenas) return;
+    for(i = 0; i < net->n; ++i){
+        layer *l = net->layers + i;
+        if(l->type == DROPOUT && i > 0){
+            l->output = net->layers[i-1].output;
+        } else if(planned_output(*net, i)){
+            l->output = calloc(l->outputs*l->batch, sizeof(float));
+        }
+    }
+    for(k = 0; k < net->narenas; ++k) free(net->arenas[k]);
+    free(net->arenas);
+    net->arenas = 0;
+    net->narenas = 0;
+    link_route_outputs(net);
+}
@@ -0,0 +1,9 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include "network.h"
+
+void plan_network_memory(network *net);
+void unplan_network_memory(network *net);
+
+#endif
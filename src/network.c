@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <assert.h>
+#include <math.h>
 #include "network.h"
 #include "image.h"
 #include "data.h"
@@ -14,6 +15,7 @@
 #include "crnn_layer.h"
 #include "local_layer.h"
 #include "convolutional_layer.h"
+#include "deconvolutional_layer.h"
 #include "activation_layer.h"
 #include "detection_layer.h"
 #include "region_layer.h"
@@ -29,6 +31,8 @@
 #include "shortcut_layer.h"
 #include "parser.h"
 #include "data.h"
+#include "memory_planner.h"
+#include "mapped_weights.h"
 
 load_args get_base_args(network net)
 {
@@ -178,7 +182,9 @@ void forward_network(network net)
         if(l.delta){
             fill_cpu(l.outputs * l.batch, 0, l.delta, 1);
         }
+        double start = net.prof ? get_wall_time() : 0;
         l.forward(l, net);
+        if(net.prof) profile_layer(net.prof, l, i, start, get_wall_time());
         net.input = l.output;
         if(l.truth) {
             net.truth = l.output;
@@ -282,31 +288,18 @@ float train_network(network net, data d)
     return (float)sum/(n*batch);
 }
 
-void set_batch_network(network *net, int b)
-{
-    net->batch = b;
-    int i;
-    for(i = 0; i < net->n; ++i){
-        net->layers[i].batch = b;
-#ifdef CUDNN
-        if(net->layers[i].type == CONVOLUTIONAL){
-            cudnn_convolutional_setup(net->layers + i);
-        }
-#endif
-    }
-}
-
-int resize_network(network *net, int w, int h)
+static void reshape_network(network *net, int w, int h, int planned)
 {
 #ifdef GPU
     cuda_set_device(net->gpu_index);
     cuda_free(net->workspace);
 #endif
     int i;
-    //if(w == net->w && h == net->h) return 0;
+    unplan_network_memory(net);
+    unlink_route_outputs(net);
     net->w = w;
     net->h = h;
-    int inputs = 0;
+    int inputs = (w && h) ? w*h*net->c : net->inputs;
     size_t workspace_size = 0;
     //fprintf(stderr, "Resizing to %d x %d...\n", w, h);
     //fflush(stderr);
@@ -314,22 +307,58 @@ int resize_network(network *net, int w, int h)
         layer l = net->layers[i];
         if(l.type == CONVOLUTIONAL){
             resize_convolutional_layer(&l, w, h);
+        }else if(l.type == DECONVOLUTIONAL){
+            resize_deconvolutional_layer(&l, h, w);
+        }else if(l.type == CONNECTED){
+            resize_connected_layer(&l, inputs);
+        }else if(l.type == LOCAL){
+            resize_local_layer(&l, w, h);
         }else if(l.type == CROP){
             resize_crop_layer(&l, w, h);
         }else if(l.type == MAXPOOL){
             resize_maxpool_layer(&l, w, h);
         }else if(l.type == REGION){
             resize_region_layer(&l, w, h);
+        }else if(l.type == DETECTION){
+            resize_detection_layer(&l, inputs);
         }else if(l.type == ROUTE){
             resize_route_layer(&l, net);
+        }else if(l.type == SHORTCUT){
+            resize_shortcut_layer(&l, net, w, h);
         }else if(l.type == REORG){
             resize_reorg_layer(&l, w, h);
         }else if(l.type == AVGPOOL){
             resize_avgpool_layer(&l, w, h);
         }else if(l.type == NORMALIZATION){
             resize_normalization_layer(&l, w, h);
+        }else if(l.type == BATCHNORM){
+            resize_batchnorm_layer(&l, w, h);
+        }else if(l.type == ACTIVE){
+            resize_activation_layer(&l, inputs);
+            l.out_w = w;
+            l.out_h = h;
+        }else if(l.type == SOFTMAX){
+            resize_softmax_layer(&l, inputs);
+        }else if(l.type == DROPOUT){
+            resize_dropout_layer(&l, inputs);
+            l.out_w = w;
+            l.out_h = h;
+            if(i > 0){
+                l.output = net->layers[i-1].output;
+                l.delta = net->layers[i-1].delta;
+#ifdef GPU
+                l.output_gpu = net->layers[i-1].output_gpu;
+                l.delta_gpu = net->layers[i-1].delta_gpu;
+#endif
+            }
         }else if(l.type == COST){
             resize_cost_layer(&l, inputs);
+        }else if(l.type == RNN){
+            resize_rnn_layer(&l, inputs);
+        }else if(l.type == GRU){
+            resize_gru_layer(&l, inputs);
+        }else if(l.type == CRNN){
+            resize_crnn_layer(&l, w, h);
         }else{
             error("Cannot resize this type of layer");
         }
@@ -338,7 +367,6 @@ int resize_network(network *net, int w, int h)
         net->layers[i] = l;
         w = l.out_w;
         h = l.out_h;
-        if(l.type == AVGPOOL) break;
     }
     layer out = get_network_output_layer(*net);
     net->inputs = net->layers[0].inputs;
@@ -365,10 +393,75 @@ int resize_network(network *net, int w, int h)
     free(net->workspace);
     net->workspace = calloc(1, workspace_size);
 #endif
+    link_route_outputs(net);
+    if(planned) plan_network_memory(net);
+    if(net->shapes) store_network_shape(net);
     //fprintf(stderr, " Done!\n");
+}
+
+void set_batch_network(network *net, int b)
+{
+    int planned = net->narenas;
+    if(net->shapes && switch_network_shape(net, net->w, net->h, b)) return;
+    net->batch = b;
+    int i;
+    for(i = 0; i < net->n; ++i){
+        net->layers[i].batch = b;
+    }
+    reshape_network(net, net->w, net->h, planned);
+}
+
+int resize_network(network *net, int w, int h)
+{
+    int planned = net->narenas;
+    if(net->shapes && switch_network_shape(net, w, h, net->batch)) return 0;
+    reshape_network(net, w, h, planned);
     return 0;
 }
 
+static size_t max_workspace_size(network *net)
+{
+    int i;
+    size_t most = 0;
+    for(i = 0; i < net->n; ++i){
+        if(net->layers[i].workspace_size > most) most = net->layers[i].workspace_size;
+    }
+    return most;
+}
+
+/* Raise a CPU layer's workspace requirement after construction, growing the shared workspace if needed. */
+void reserve_layer_workspace(network *net, layer *l, size_t size)
+{
+    size_t before = max_workspace_size(net);
+    if(size > l->workspace_size) l->workspace_size = size;
+    size_t after = max_workspace_size(net);
+    if(after > before){
+        free(net->workspace);
+        net->workspace = calloc(1, after);
+    }
+}
+
+/* Input size with the image's aspect ratio, in multiples of the network stride, whose
+   area stays under max_pixels and never exceeds the image's own area. */
+void fit_network_input(network net, int w, int h, int max_pixels, int *net_w, int *net_h)
+{
+    layer out = get_network_output_layer(net);
+    int stride = (out.w && net.w % out.w == 0) ? net.w / out.w : 32;
+    float area = w*h < max_pixels ? w*h : max_pixels;
+    float aspect = (float)w/h;
+
+    int nh = (int)(sqrt(area/aspect)/stride + .5)*stride;
+    if(nh < stride) nh = stride;
+    int nw = (int)(nh*aspect/stride + .5)*stride;
+    if(nw < stride) nw = stride;
+    while(nw*nh > max_pixels && (nw > stride || nh > stride)){
+        if((nw > nh && nw > stride) || nh == stride) nw -= stride;
+        else nh -= stride;
+    }
+    *net_w = nw;
+    *net_h = nh;
+}
+
 detection_layer get_network_detection_layer(network net)
 {
     int i;
@@ -566,17 +659,32 @@ float network_accuracy_multi(network net, data d, int n)
 
 void free_network(network net)
 {
-    int i;
+    int i, j;
+    free_shape_cache(&net);
+    release_mapped_weights(&net);
     for(i = 0; i < net.n; ++i){
+        for(j = 0; j < net.narenas; ++j){
+            if(net.layers[i].output == net.arenas[j]) net.layers[i].output = 0;
+        }
         free_layer(net.layers[i]);
     }
+    for(j = 0; j < net.narenas; ++j) free(net.arenas[j]);
+    free(net.arenas);
     free(net.layers);
     if(net.input) free(net.input);
     if(net.truth) free(net.truth);
+    free_profiler(net.prof);
 #ifdef GPU
+    if(gpu_index >= 0){
+        if(net.workspace) cuda_free(net.workspace);
+    } else {
+        free(net.workspace);
+    }
     if(net.input_gpu) cuda_free(net.input_gpu);
     if(net.truth_gpu) cuda_free(net.truth_gpu);
     // if(net.delta_gpu) cuda_free(net.delta_gpu);
+#else
+    free(net.workspace);
 #endif
 }
 
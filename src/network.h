@@ -6,6 +6,8 @@
 #include "layer.h"
 #include "data.h"
 #include "tree.h"
+#include "profiler.h"
+#include "shape_cache.h"
 
 typedef enum {
     CONSTANT, STEP, EXP, POLY, STEPS, SIG, RANDOM
@@ -66,6 +68,12 @@ typedef struct network{
     int train;
     int index;
     float *cost;
+    profiler *prof;
+    float **arenas;
+    int narenas;
+    void *mapped;
+    size_t mapped_size;
+    shape_cache *shapes;
 
     #ifdef GPU
     float *input_gpu;
@@ -117,7 +125,9 @@ int get_predicted_class_network(network net);
 void print_network(network net);
 void visualize_network(network net);
 int resize_network(network *net, int w, int h);
+void fit_network_input(network net, int w, int h, int max_pixels, int *net_w, int *net_h);
 void set_batch_network(network *net, int b);
+void reserve_layer_workspace(network *net, layer *l, size_t size);
 network load_network(char *cfg, char *weights, int clear);
 load_args get_base_args(network net);
 void calc_network_cost(network net);
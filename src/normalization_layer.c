@@ -1,6 +1,7 @@
 #include "normalization_layer.h"
 #include "blas.h"
 #include <stdio.h>
+#include <math.h>
 
 layer make_normalization_layer(int batch, int w, int h, int c, int size, float alpha, float beta, float kappa)
 {
@@ -62,35 +63,60 @@ void resize_normalization_layer(layer *layer, int w, int h)
 #endif
 }
 
+/* Pixels whose running channel sums are carried through the channel loop together. */
+#define LRN_TILE 256
+
+/* n^-beta, with the common AlexNet beta done as two square roots instead of powf. */
+static inline float lrn_scale(float n, float beta)
+{
+    if(beta == .75f) return 1.f/sqrtf(n*sqrtf(n));
+    return powf(n, -beta);
+}
+
+/* Same running window as the GPU path (and the same sums, in the same order), walked one tile of
+   pixels at a time so the squares and norms never leave cache. norms is only kept for training. */
 void forward_normalization_layer(const layer layer, network net)
 {
-    int k,b;
-    int w = layer.w;
-    int h = layer.h;
+    int b, k, i, p;
+    int spatial = layer.w*layer.h;
     int c = layer.c;
-    scal_cpu(w*h*c*layer.batch, 0, layer.squared, 1);
+    float alpha = layer.alpha;
+    float beta = layer.beta;
+    float sum[LRN_TILE];
 
     for(b = 0; b < layer.batch; ++b){
-        float *squared = layer.squared + w*h*c*b;
-        float *norms   = layer.norms + w*h*c*b;
-        float *input   = net.input + w*h*c*b;
-        pow_cpu(w*h*c, 2, input, 1, squared, 1);
-
-        const_cpu(w*h, layer.kappa, norms, 1);
-        for(k = 0; k < layer.size/2; ++k){
-            axpy_cpu(w*h, layer.alpha, squared + w*h*k, 1, norms, 1);
-        }
-
-        for(k = 1; k < layer.c; ++k){
-            copy_cpu(w*h, norms + w*h*(k-1), 1, norms + w*h*k, 1);
-            int prev = k - ((layer.size-1)/2) - 1;
-            int next = k + (layer.size/2);
-            if(prev >= 0)      axpy_cpu(w*h, -layer.alpha, squared + w*h*prev, 1, norms + w*h*k, 1);
-            if(next < layer.c) axpy_cpu(w*h,  layer.alpha, squared + w*h*next, 1, norms + w*h*k, 1);
+        float *input = net.input + spatial*c*b;
+        float *output = layer.output + spatial*c*b;
+        float *norms = layer.norms + spatial*c*b;
+        for(p = 0; p < spatial; p += LRN_TILE){
+            int n = (spatial - p < LRN_TILE) ? spatial - p : LRN_TILE;
+            for(i = 0; i < n; ++i) sum[i] = layer.kappa;
+            for(k = 0; k < layer.size/2 && k < c; ++k){
+                float *x = input + spatial*k + p;
+                for(i = 0; i < n; ++i) sum[i] += alpha*(x[i]*x[i]);
+            }
+            for(k = 0; k < c; ++k){
+                int prev = k - ((layer.size-1)/2) - 1;
+                int next = k + (layer.size/2);
+                if(prev >= 0){
+                    float *x = input + spatial*prev + p;
+                    for(i = 0; i < n; ++i) sum[i] -= alpha*(x[i]*x[i]);
+                }
+                if(k > 0 && next < c){
+                    float *x = input + spatial*next + p;
+                    for(i = 0; i < n; ++i) sum[i] += alpha*(x[i]*x[i]);
+                }
+                float *x = input + spatial*k + p;
+                float *y = output + spatial*k + p;
+                if(net.train) copy_cpu(n, sum, 1, norms + spatial*k + p, 1);
+                if(beta == .75f){
+                    for(i = 0; i < n; ++i) y[i] = x[i]/sqrtf(sum[i]*sqrtf(sum[i]));
+                } else {
+                    for(i = 0; i < n; ++i) y[i] = x[i]*lrn_scale(sum[i], beta);
+                }
+            }
         }
     }
-    pow_cpu(w*h*c*layer.batch, -layer.beta, layer.norms, 1, layer.output, 1);
-    mul_cpu(w*h*c*layer.batch, net.input, 1, layer.output, 1);
 }
 
 void backward_normalization_layer(const layer layer, network net)
@@ -98,11 +124,9 @@ void backward_normalization_layer(const layer layer, network net)
     // TODO This is approximate ;-)
     // Also this should add in to delta instead of overwritting.
 
-    int w = layer.w;
-    int h = layer.h;
-    int c = layer.c;
-    pow_cpu(w*h*c*layer.batch, -layer.beta, layer.norms, 1, net.delta, 1);
-    mul_cpu(w*h*c*layer.batch, layer.delta, 1, net.delta, 1);
+    int i;
+    int n = layer.w*layer.h*layer.c*layer.batch;
+    for(i = 0; i < n; ++i) net.delta[i] = layer.delta[i]*lrn_scale(layer.norms[i], layer.beta);
 }
 
 #ifdef GPU
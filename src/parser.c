@@ -7,6 +7,8 @@
 #include "assert.h"
 #include "avgpool_layer.h"
 #include "batchnorm_layer.h"
+#include "bitpack.h"
+#include "winograd.h"
 #include "blas.h"
 #include "connected_layer.h"
 #include "deconvolutional_layer.h"
@@ -19,6 +21,7 @@
 #include "gru_layer.h"
 #include "list.h"
 #include "local_layer.h"
+#include "mapped_weights.h"
 #include "maxpool_layer.h"
 #include "normalization_layer.h"
 #include "option_list.h"
@@ -114,6 +117,7 @@ typedef struct size_params{
     int c;
     int index;
     int time_steps;
+    int train;
     network net;
 } size_params;
 
@@ -171,6 +175,7 @@ convolutional_layer parse_convolutional(list *options, size_params params)
     int stride = option_find_int(options, "stride",1);
     int pad = option_find_int_quiet(options, "pad",0);
     int padding = option_find_int_quiet(options, "padding",0);
+    int groups = option_find_int_quiet(options, "groups", 1);
     if(pad) padding = size/2;
 
     char *activation_s = option_find_str(options, "activation", "logistic");
@@ -185,8 +190,9 @@ convolutional_layer parse_convolutional(list *options, size_params params)
     int batch_normalize = option_find_int_quiet(options, "batch_normalize", 0);
     int binary = option_find_int_quiet(options, "binary", 0);
     int xnor = option_find_int_quiet(options, "xnor", 0);
+    if(groups < 1 || c % groups || n % groups) error("Convolutional groups must divide both the input channels and the filters");
 
-    convolutional_layer layer = make_convolutional_layer(batch,h,w,c,n,size,stride,padding,activation, batch_normalize, binary, xnor, params.net.adam);
+    convolutional_layer layer = make_convolutional_layer(batch,h,w,c,n,groups,size,stride,padding,activation, batch_normalize, binary, xnor, params.net.adam, params.train);
     layer.flipped = option_find_int_quiet(options, "flipped", 0);
     layer.dot = option_find_float_quiet(options, "dot", 0);
     if(params.net.adam){
@@ -246,7 +252,7 @@ connected_layer parse_connected(list *options, size_params params)
     ACTIVATION activation = get_activation(activation_s);
     int batch_normalize = option_find_int_quiet(options, "batch_normalize", 0);
 
-    connected_layer layer = make_connected_layer(params.batch, params.inputs, output, activation, batch_normalize);
+    connected_layer layer = make_connected_layer(params.batch, params.inputs, output, activation, batch_normalize, params.train);
 
     return layer;
 }
@@ -267,7 +273,7 @@ layer parse_region(list *options, size_params params)
     int classes = option_find_int(options, "classes", 20);
     int num = option_find_int(options, "num", 1);
 
-    layer l = make_region_layer(params.batch, params.w, params.h, num, classes, coords);
+    layer l = make_region_layer(params.batch, params.w, params.h, num, classes, coords, params.train);
     assert(l.outputs == params.inputs);
 
     l.log = option_find_int_quiet(options, "log", 0);
@@ -383,7 +389,7 @@ layer parse_reorg(list *options, size_params params)
     batch=params.batch;
     if(!(h && w && c)) error("Layer before reorg layer must output image.");
 
-    layer layer = make_reorg_layer(batch,w,h,c,stride,reverse, flatten, extra);
+    layer layer = make_reorg_layer(batch,w,h,c,stride,reverse, flatten, extra, params.train);
     return layer;
 }
 
@@ -400,7 +406,7 @@ maxpool_layer parse_maxpool(list *options, size_params params)
     batch=params.batch;
     if(!(h && w && c)) error("Layer before maxpool layer must output image.");
 
-    maxpool_layer layer = make_maxpool_layer(batch,h,w,c,size,stride,padding);
+    maxpool_layer layer = make_maxpool_layer(batch,h,w,c,size,stride,padding,params.train);
     return layer;
 }
 
@@ -439,7 +445,7 @@ layer parse_normalization(list *options, size_params params)
 
 layer parse_batchnorm(list *options, size_params params)
 {
-    layer l = make_batchnorm_layer(params.batch, params.w, params.h, params.c);
+    layer l = make_batchnorm_layer(params.batch, params.w, params.h, params.c, params.train);
     return l;
 }
 
@@ -452,7 +458,7 @@ layer parse_shortcut(list *options, size_params params, network net)
     int batch = params.batch;
     layer from = net.layers[index];
 
-    layer s = make_shortcut_layer(batch, index, params.w, params.h, params.c, from.out_w, from.out_h, from.out_c);
+    layer s = make_shortcut_layer(batch, index, params.w, params.h, params.c, from.out_w, from.out_h, from.out_c, params.train);
 
     char *activation_s = option_find_str(options, "activation", "linear");
     ACTIVATION activation = get_activation(activation_s);
@@ -500,7 +506,7 @@ route_layer parse_route(list *options, size_params params, network net)
     }
     int batch = params.batch;
 
-    route_layer layer = make_route_layer(batch, n, layers, sizes);
+    route_layer layer = make_route_layer(batch, n, layers, sizes, params.train);
 
     convolutional_layer first = net.layers[layers[0]];
     layer.out_w = first.out_w;
@@ -694,7 +700,7 @@ int is_network(section *s)
 }
 
 
-network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
+network parse_network_cfg_custom(char *filename, cfg_param *grid_parameters, int train)
 {
     list *sections = read_cfg(filename);
     node *n = sections->front;
@@ -706,7 +712,8 @@ network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
     section *s = (section *)n->val;
     list *options = s->options;
     if(!is_network(s)) error("First section must be [net] or [network]");
-    parse_net_options_param(options, &net, grid_parameters);
+    if(grid_parameters) parse_net_options_param(options, &net, *grid_parameters);
+    else parse_net_options(options, &net);
 
     params.h = net.h;
     params.w = net.w;
@@ -714,6 +721,7 @@ network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
     params.inputs = net.inputs;
     params.batch = net.batch;
     params.time_steps = net.time_steps;
+    params.train = train;
     params.net = net;
 
     size_t workspace_size = 0;
@@ -806,6 +814,7 @@ network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
     net.truths = out.outputs;
     if(net.layers[net.n-1].truths) net.truths = net.layers[net.n-1].truths;
     net.output = out.output;
+    link_route_outputs(&net);
     net.input = calloc(net.inputs*net.batch, sizeof(float));
     net.truth = calloc(net.truths*net.batch, sizeof(float));
 #ifdef GPU
@@ -830,136 +839,12 @@ network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
 
 network parse_network_cfg(char *filename)
 {
-    list *sections = read_cfg(filename);
-    node *n = sections->front;
-    if(!n) error("Config file has no sections");
-    network net = make_network(sections->size - 1);
-    net.gpu_index = gpu_index;
-    size_params params;
-
-    section *s = (section *)n->val;
-    list *options = s->options;
-    if(!is_network(s)) error("First section must be [net] or [network]");
-    parse_net_options(options, &net);
-
-    params.h = net.h;
-    params.w = net.w;
-    params.c = net.c;
-    params.inputs = net.inputs;
-    params.batch = net.batch;
-    params.time_steps = net.time_steps;
-    params.net = net;
+    return parse_network_cfg_custom(filename, 0, 1);
+}
 
-    size_t workspace_size = 0;
-    n = n->next;
-    int count = 0;
-    free_section(s);
-    fprintf(stderr, "layer     filters    size              input                output\n");
-    while(n){
-        params.index = count;
-        fprintf(stderr, "%5d ", count);
-        s = (section *)n->val;
-        options = s->options;
-        layer l = {0};
-        LAYER_TYPE lt = string_to_layer_type(s->type);
-        if(lt == CONVOLUTIONAL){
-            l = parse_convolutional(options, params);
-        }else if(lt == DECONVOLUTIONAL){
-            l = parse_deconvolutional(options, params);
-        }else if(lt == LOCAL){
-            l = parse_local(options, params);
-        }else if(lt == ACTIVE){
-            l = parse_activation(options, params);
-        }else if(lt == RNN){
-            l = parse_rnn(options, params);
-        }else if(lt == GRU){
-            l = parse_gru(options, params);
-        }else if(lt == CRNN){
-            l = parse_crnn(options, params);
-        }else if(lt == CONNECTED){
-            l = parse_connected(options, params);
-        }else if(lt == CROP){
-            l = parse_crop(options, params);
-        }else if(lt == COST){
-            l = parse_cost(options, params);
-        }else if(lt == REGION){
-            l = parse_region(options, params);
-        }else if(lt == DETECTION){
-            l = parse_detection(options, params);
-        }else if(lt == SOFTMAX){
-            l = parse_softmax(options, params);
-            net.hierarchy = l.softmax_tree;
-        }else if(lt == NORMALIZATION){
-            l = parse_normalization(options, params);
-        }else if(lt == BATCHNORM){
-            l = parse_batchnorm(options, params);
-        }else if(lt == MAXPOOL){
-            l = parse_maxpool(options, params);
-        }else if(lt == REORG){
-            l = parse_reorg(options, params);
-        }else if(lt == AVGPOOL){
-            l = parse_avgpool(options, params);
-        }else if(lt == ROUTE){
-            l = parse_route(options, params, net);
-        }else if(lt == SHORTCUT){
-            l = parse_shortcut(options, params, net);
-        }else if(lt == DROPOUT){
-            l = parse_dropout(options, params);
-            l.output = net.layers[count-1].output;
-            l.delta = net.layers[count-1].delta;
-#ifdef GPU
-            l.output_gpu = net.layers[count-1].output_gpu;
-            l.delta_gpu = net.layers[count-1].delta_gpu;
-#endif
-        }else{
-            fprintf(stderr, "Type not recognized: %s\n", s->type);
-        }
-        l.truth = option_find_int_quiet(options, "truth", 0);
-        l.onlyforward = option_find_int_quiet(options, "onlyforward", 0);
-        l.stopbackward = option_find_int_quiet(options, "stopbackward", 0);
-        l.dontload = option_find_int_quiet(options, "dontload", 0);
-        l.dontloadscales = option_find_int_quiet(options, "dontloadscales", 0);
-        l.learning_rate_scale = option_find_float_quiet(options, "learning_rate", 1);
-        l.smooth = option_find_float_quiet(options, "smooth", 0);
-        option_unused(options);
-        net.layers[count] = l;
-        if (l.workspace_size > workspace_size) workspace_size = l.workspace_size;
-        free_section(s);
-        n = n->next;
-        ++count;
-        if(n){
-            params.h = l.out_h;
-            params.w = l.out_w;
-            params.c = l.out_c;
-            params.inputs = l.outputs;
-        }
-    }
-    free_list(sections);
-    layer out = get_network_output_layer(net);
-    net.outputs = out.outputs;
-    net.truths = out.outputs;
-    if(net.layers[net.n-1].truths) net.truths = net.layers[net.n-1].truths;
-    net.output = out.output;
-    net.input = calloc(net.inputs*net.batch, sizeof(float));
-    net.truth = calloc(net.truths*net.batch, sizeof(float));
-#ifdef GPU
-    net.output_gpu = out.output_gpu;
-    net.input_gpu = cuda_make_array(net.input, net.inputs*net.batch);
-    net.truth_gpu = cuda_make_array(net.truth, net.truths*net.batch);
-#endif
-    if(workspace_size){
-        //printf("%ld\n", workspace_size);
-#ifdef GPU
-        if(gpu_index >= 0){
-            net.workspace = cuda_make_array(0, (workspace_size-1)/sizeof(float)+1);
-        }else {
-            net.workspace = calloc(1, workspace_size);
-        }
-#else
-        net.workspace = calloc(1, workspace_size);
-#endif
-    }
-    return net;
+network parse_network_cfg_param(char *filename, cfg_param grid_parameters)
+{
+    return parse_network_cfg_custom(filename, &grid_parameters, 1);
 }
 
 list *read_cfg(char *filename)
@@ -1004,8 +889,8 @@ void save_convolutional_weights_binary(layer l, FILE *fp)
         pull_convolutional_layer(l);
     }
 #endif
-    binarize_weights(l.weights, l.n, l.c*l.size*l.size, l.binary_weights);
-    int size = l.c*l.size*l.size;
+    int size = l.nweights/l.n;
+    binarize_weights(l.weights, l.n, size, l.binary_weights);
     int i, j, k;
     fwrite(l.biases, sizeof(float), l.n, fp);
     if (l.batch_normalize){
@@ -1029,8 +914,17 @@ void save_convolutional_weights_binary(layer l, FILE *fp)
     }
 }
 
+/* Converted layers keep only their compact weights, which the darknet format can't hold. */
+static void check_float_weights(layer l)
+{
+    if(l.quantized) error("Quantized layers can only be saved with save_mapped_weights");
+    if(l.half) error("Half precision layers can only be saved with save_mapped_weights");
+    if(l.bitpacked) error("Bit-packed layers can only be saved with save_mapped_weights");
+}
+
 void save_convolutional_weights(layer l, FILE *fp)
 {
+    check_float_weights(l);
     if(l.binary){
         //save_convolutional_weights_binary(l, fp);
         //return;
@@ -1040,7 +934,7 @@ void save_convolutional_weights(layer l, FILE *fp)
         pull_convolutional_layer(l);
     }
 #endif
-    int num = l.n*l.c*l.size*l.size;
+    int num = l.nweights;
     fwrite(l.biases, sizeof(float), l.n, fp);
     if (l.batch_normalize){
         fwrite(l.scales, sizeof(float), l.n, fp);
@@ -1068,6 +962,7 @@ void save_batchnorm_weights(layer l, FILE *fp)
 
 void save_connected_weights(layer l, FILE *fp)
 {
+    check_float_weights(l);
 #ifdef GPU
     if(gpu_index >= 0){
         pull_connected_layer(l);
@@ -1201,7 +1096,7 @@ void load_convolutional_weights_binary(layer l, FILE *fp)
         fread(l.rolling_mean, sizeof(float), l.n, fp);
         fread(l.rolling_variance, sizeof(float), l.n, fp);
     }
-    int size = l.c*l.size*l.size;
+    int size = l.nweights/l.n;
     int i, j, k;
     for(i = 0; i < l.n; ++i){
         float mean = 0;
@@ -1229,7 +1124,7 @@ void load_convolutional_weights(layer l, FILE *fp)
         //load_convolutional_weights_binary(l, fp);
         //return;
     }
-    int num = l.n*l.c*l.size*l.size;
+    int num = l.nweights;
     fread(l.biases, sizeof(float), l.n, fp);
     if (l.batch_normalize && (!l.dontloadscales)){
         fread(l.scales, sizeof(float), l.n, fp);
@@ -1258,7 +1153,7 @@ void load_convolutional_weights(layer l, FILE *fp)
     }
     //if(l.c == 3) scal_cpu(num, 1./256, l.weights, 1);
     if (l.flipped) {
-        transpose_matrix(l.weights, l.c*l.size*l.size, l.n);
+        transpose_matrix(l.weights, l.nweights/l.n, l.n);
     }
     //if (l.binary) binarize_weights(l.weights, l.n, l.c*l.size*l.size, l.weights);
 #ifdef GPU
@@ -1278,6 +1173,13 @@ void load_weights_upto(network *net, char *filename, int start, int cutoff)
 #endif
     fprintf(stderr, "Loading weights from %s...", filename);
     fflush(stdout);
+    if(is_mapped_weights(filename)){
+        load_mapped_weights_upto(net, filename, start, cutoff);
+        pack_network_weights(net, start, cutoff);
+        transform_network_weights(net, start, cutoff);
+        fprintf(stderr, "Done!\n");
+        return;
+    }
     FILE *fp = fopen(filename, "rb");
     if(!fp) file_error(filename);
 
@@ -1333,6 +1235,8 @@ void load_weights_upto(network *net, char *filename, int start, int cutoff)
 #endif
         }
     }
+    pack_network_weights(net, start, cutoff);
+    transform_network_weights(net, start, cutoff);
     fprintf(stderr, "Done!\n");
     fclose(fp);
 }
@@ -5,6 +5,7 @@
 
 network parse_network_cfg(char *filename);
 network parse_network_cfg_param(char *filename, cfg_param grid_parameters);
+network parse_network_cfg_custom(char *filename, cfg_param *grid_parameters, int train);
 void save_network(network net, char *filename);
 void save_weights(network net, char *filename);
 void save_weights_upto(network net, char *filename, int cutoff);
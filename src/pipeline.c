@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "network.h"
+#include "detection_layer.h"
+#include "region_layer.h"
+#include "parser.h"
+#include "memory_planner.h"
+#include "image.h"
+#include "data.h"
+#include "list.h"
+#include "box.h"
+#include "utils.h"
+#include "video.h"
+#include "tracker.h"
+#include "cuda.h"
+
+/* Batches each queue holds, so every stage can run one batch ahead of the next. */
+#define PIPELINE_DEPTH 2
+#define PIPELINE_STAGES 5
+
+typedef struct {
+    image im;
+    image letter;
+    float *prediction;
+    int index;
+} pipeline_frame;
+
+/* Bounded FIFO of frames; a null frame marks the end of the stream. */
+typedef struct {
+    pipeline_frame **items;
+    int size;
+    int head;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} frame_queue;
+
+typedef struct {
+    char **paths;
+    int n;
+    int i;
+    video_stream *video;
+#ifdef OPENCV
+    CvCapture *cap;
+#endif
+} frame_source;
+
+typedef struct {
+    int frames;
+    double busy;
+} stage_stats;
+
+typedef struct pipeline pipeline;
+
+typedef void (*stage_func)(pipeline *p, pipeline_frame *f);
+
+struct pipeline {
+    network net;
+    layer l;
+    frame_source source;
+    frame_queue queues[PIPELINE_STAGES];
+    pipeline_frame *frames;
+    int nframes;
+    int batch;
+    float *input;
+
+    float thresh;
+    float hier;
+    char **names;
+    image **alphabet;
+    int classes;
+    char *prefix;
+    FILE *json;
+
+    float **predictions;
+    float *avg;
+    int avg_frames;
+    box *boxes;
+    float **probs;
+    tracker *tracker;
+    int *ids;
+
+    stage_stats stats[PIPELINE_STAGES];
+    pthread_mutex_t stats_mutex;
+    double start;
+    double last_report;
+};
+
+typedef struct {
+    pipeline *p;
+    int stage;
+} stage_args;
+
+static char *stage_names[PIPELINE_STAGES] = {"decode", "letterbox", "inference", "post", "encode"};
+
+static void init_queue(frame_queue *q, int size)
+{
+    q->items = calloc(size, sizeof(pipeline_frame *));
+    q->size = size;
+    q->head = q->count = 0;
+    pthread_mutex_init(&q->mutex, 0);
+    pthread_cond_init(&q->not_empty, 0);
+    pthread_cond_init(&q->not_full, 0);
+}
+
+static void free_queue(frame_queue *q)
+{
+    free(q->items);
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void push_frame(frame_queue *q, pipeline_frame *f)
+{
+    pthread_mutex_lock(&q->mutex);
+    while(q->count == q->size) pthread_cond_wait(&q->not_full, &q->mutex);
+    q->items[(q->head + q->count) % q->size] = f;
+    ++q->count;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static pipeline_frame *pop_frame(frame_queue *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    while(q->count == 0) pthread_cond_wait(&q->not_empty, &q->mutex);
+    pipeline_frame *f = q->items[q->head];
+    q->head = (q->head + 1) % q->size;
+    --q->count;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+    return f;
+}
+
+/* A .txt or .list file names one image per line, anything else is a video. OpenCV builds
+   keep decoding video files through OpenCV; stdin and .y4m/.rgb streams never need it. */
+static void open_frame_source(frame_source *s, char *filename, int w, int h)
+{
+    memset(s, 0, sizeof(frame_source));
+    if(!filename) error("Headless demo needs an input file");
+    if(strstr(filename, ".txt") || strstr(filename, ".list")){
+        list *plist = get_paths(filename);
+        s->n = plist->size;
+        s->paths = (char **)list_to_array(plist);
+        free_list(plist);
+        return;
+    }
+#ifdef OPENCV
+    if(strcmp(filename, "-") && !strstr(filename, ".y4m") && !strstr(filename, ".rgb")){
+        s->cap = cvCaptureFromFile(filename);
+        if(!s->cap) error("Couldn't open video file.\n");
+        return;
+    }
+#endif
+    s->video = open_video_stream(filename, w, h);
+}
+
+static void close_frame_source(frame_source *s)
+{
+    if(s->paths) free_ptrs((void **)s->paths, s->n);
+    close_video_stream(s->video);
+#ifdef OPENCV
+    if(s->cap) cvReleaseCapture(&s->cap);
+#endif
+}
+
+/* Fills *im with the next frame, returns 0 at the end of the stream. Video frames are decoded into
+   the slot and only reallocate when the size changes; image list frames are loaded fresh. */
+static int next_frame(frame_source *s, image *im)
+{
+    if(s->video) return read_video_frame(s->video, im);
+#ifdef OPENCV
+    if(s->cap){
+        IplImage *src = cvQueryFrame(s->cap);
+        if(!src) return 0;
+        if(im->w != src->width || im->h != src->height || im->c != src->nChannels){
+            free_image(*im);
+            *im = make_image(src->width, src->height, src->nChannels);
+        }
+        ipl_into_image(src, *im);
+        rgbgr_image(*im);
+        return 1;
+    }
+#endif
+    free_image(*im);
+    *im = make_empty_image(0,0,0);
+    if(s->i == s->n) return 0;
+    *im = load_image_color(s->paths[s->i++], 0, 0);
+    return 1;
+}
+
+static void letterbox_stage(pipeline *p, pipeline_frame *f)
+{
+    fill_image(f->letter, .5);
+    letterbox_image_into(f->im, p->net.w, p->net.h, f->letter);
+}
+
+
+/* One line per frame: {"frame":n,"detections":[{"class":..,"prob":..,"x":..,"y":..,"w":..,"h":..}]}
+   with the box center and size relative to the frame, plus the track "id" when tracking. */
+static void write_json_detections(pipeline *p, int index)
+{
+    int i, j;
+    int n = 0;
+    fprintf(p->json, "{\"frame\":%d,\"detections\":[", index);
+    for(i = 0; i < p->l.w*p->l.h*p->l.n; ++i){
+        box b = p->boxes[i];
+        for(j = 0; j < p->classes; ++j){
+            if(p->probs[i][j] <= p->thresh) continue;
+            fprintf(p->json, "%s{", n++ ? "," : "");
+            if(p->ids) fprintf(p->json, "\"id\":%d,", p->ids[i]);
+            fprintf(p->json, "\"class\":\"%s\",\"prob\":%.4f,\"x\":%.4f,\"y\":%.4f,\"w\":%.4f,\"h\":%.4f}",
+                    p->names[j], p->probs[i][j], b.x, b.y, b.w, b.h);
+        }
+    }
+    fprintf(p->json, "]}\n");
+}
+
+/* Frames arrive in order, so the running average and the tracker see the same sequence as demo(). */
+static void post_stage(pipeline *p, pipeline_frame *f)
+{
+    float nms = .4;
+    layer l = p->l;
+    if(p->tracker){
+        l.output = f->prediction;
+    } else {
+        memcpy(p->predictions[f->index % p->avg_frames], f->prediction, l.outputs*sizeof(float));
+        mean_arrays(p->predictions, p->avg_frames, l.outputs, p->avg);
+        l.output = p->avg;
+    }
+    if(l.type == DETECTION){
+        get_detection_boxes(l, 1, 1, p->thresh, p->probs, p->boxes, 0);
+    } else {
+        get_region_boxes(l, f->im.w, f->im.h, p->net.w, p->net.h, p->thresh, p->probs, p->boxes, 0, 0, p->hier, 1);
+    }
+    if (nms > 0) do_nms_obj(p->boxes, p->probs, l.w*l.h*l.n, l.classes, nms);
+    if(p->tracker) track_detections(p->tracker, p->boxes, p->probs, l.w*l.h*l.n, l.classes, p->thresh, p->ids);
+    if(p->json) write_json_detections(p, f->index);
+    if(p->prefix) draw_detections(f->im, l.w*l.h*l.n, p->thresh, p->boxes, p->probs, p->names, p->alphabet, p->classes);
+}
+
+static void print_pipeline_stats(pipeline *p, double now)
+{
+    int i;
+    pthread_mutex_lock(&p->stats_mutex);
+    int frames = p->stats[PIPELINE_STAGES-1].frames;
+    fprintf(stderr, "%d frames, %.1f fps |", frames, frames/(now - p->start));
+    for(i = 0; i < PIPELINE_STAGES; ++i){
+        stage_stats s = p->stats[i];
+        fprintf(stderr, " %s %.1f", stage_names[i], s.busy > 0 ? s.frames/s.busy : 0);
+    }
+    fprintf(stderr, "\n");
+    pthread_mutex_unlock(&p->stats_mutex);
+}
+
+static void encode_stage(pipeline *p, pipeline_frame *f)
+{
+    if(p->prefix){
+        char name[256];
+        sprintf(name, "%s_%08d", p->prefix, f->index);
+        save_image(f->im, name);
+    }
+}
+
+static stage_func stage_funcs[PIPELINE_STAGES] = {0, letterbox_stage, 0, post_stage, encode_stage};
+
+static void count_frames(pipeline *p, int stage, double start, int n)
+{
+    double now = get_wall_time();
+    pthread_mutex_lock(&p->stats_mutex);
+    p->stats[stage].frames += n;
+    p->stats[stage].busy += now - start;
+    int report = stage == PIPELINE_STAGES-1 && now - p->last_report > 1;
+    if(report) p->last_report = now;
+    pthread_mutex_unlock(&p->stats_mutex);
+    if(report) print_pipeline_stats(p, now);
+}
+
+/* Decode pulls empty frames from the queue the encode stage hands finished frames to. */
+static void *decode_loop(pipeline *p)
+{
+    int index = 0;
+    frame_queue *recycled = p->queues + PIPELINE_STAGES - 1;
+    while(1){
+        pipeline_frame *f = pop_frame(recycled);
+        double start = get_wall_time();
+        if(!next_frame(&p->source, &f->im)){
+            push_frame(p->queues, 0);
+            return 0;
+        }
+        f->index = index++;
+        count_frames(p, 0, start, 1);
+        push_frame(p->queues, f);
+    }
+}
+
+/* Waits for a full batch, or the end of the stream, and runs it through the network at once. */
+static void *inference_loop(pipeline *p)
+{
+    int i, done = 0;
+    int inputs = p->net.inputs;
+    int outputs = p->l.outputs;
+    pipeline_frame **batch = calloc(p->batch, sizeof(pipeline_frame *));
+    while(!done){
+        int n = 0;
+        while(n < p->batch){
+            pipeline_frame *f = pop_frame(p->queues + 1);
+            if(!f){
+                done = 1;
+                break;
+            }
+            batch[n++] = f;
+        }
+        if(!n) break;
+        double start = get_wall_time();
+        for(i = 0; i < n; ++i) memcpy(p->input + i*inputs, batch[i]->letter.data, inputs*sizeof(float));
+        float *prediction = network_predict(p->net, p->input);
+        for(i = 0; i < n; ++i) memcpy(batch[i]->prediction, prediction + i*outputs, outputs*sizeof(float));
+        count_frames(p, 2, start, n);
+        for(i = 0; i < n; ++i) push_frame(p->queues + 2, batch[i]);
+    }
+    push_frame(p->queues + 2, 0);
+    free(batch);
+    return 0;
+}
+
+static void *stage_thread(void *ptr)
+{
+    stage_args args = *(stage_args *)ptr;
+    free(ptr);
+    pipeline *p = args.p;
+    int stage = args.stage;
+#ifdef GPU
+    if(stage == 2 && gpu_index >= 0) cuda_set_device(gpu_index);
+#endif
+    if(stage == 0) return decode_loop(p);
+    if(stage == 2) return inference_loop(p);
+    while(1){
+        pipeline_frame *f = pop_frame(p->queues + stage - 1);
+        if(!f){
+            if(stage < PIPELINE_STAGES - 1) push_frame(p->queues + stage, 0);
+            return 0;
+        }
+        double start = get_wall_time();
+        stage_funcs[stage](p, f);
+        count_frames(p, stage, start, 1);
+        push_frame(p->queues + stage, f);
+    }
+}
+
+/* demo() without a display: every step runs in its own long-lived thread, handing frames on through
+   bounded queues, so throughput is set by the slowest stage instead of the sum of all of them.
+   Frames can be annotated into prefix_%08d images and/or written as JSON lines to outfile.
+   With track set, detections are smoothed by a tracker instead of averaging avg_frames outputs. */
+void demo_pipeline(char *cfgfile, char *weightfile, float thresh, float hier, char *filename, char **names, int classes, char *prefix, char *outfile, int avg_frames, int track, int batch, int w, int h)
+{
+    int i, j;
+    pipeline *p = calloc(1, sizeof(pipeline));
+    p->net = parse_network_cfg_custom(cfgfile, 0, 0);
+    if(weightfile){
+        load_weights(&p->net, weightfile);
+    }
+    p->batch = batch > 0 ? batch : 1;
+    set_batch_network(&p->net, p->batch);
+    plan_network_memory(&p->net);
+    p->l = p->net.layers[p->net.n-1];
+    if(p->l.type != DETECTION && p->l.type != REGION) error("Last layer must produce detections\n");
+    layer l = p->l;
+
+    p->thresh = thresh;
+    p->hier = hier;
+    p->names = names;
+    if(prefix) p->alphabet = load_alphabet();
+    p->classes = classes;
+    p->prefix = prefix;
+    if(outfile){
+        p->json = strcmp(outfile, "-") ? fopen(outfile, "w") : stdout;
+        if(!p->json) file_error(outfile);
+    }
+    if(track){
+        p->tracker = make_tracker(.3, 3);
+        p->ids = calloc(l.w*l.h*l.n, sizeof(int));
+    } else {
+        p->avg_frames = avg_frames > 0 ? avg_frames : 1;
+        p->predictions = calloc(p->avg_frames, sizeof(float *));
+        for(j = 0; j < p->avg_frames; ++j) p->predictions[j] = calloc(l.outputs, sizeof(float));
+        p->avg = calloc(l.outputs, sizeof(float));
+    }
+    p->boxes = calloc(l.w*l.h*l.n, sizeof(box));
+    p->probs = calloc(l.w*l.h*l.n, sizeof(float *));
+    for(j = 0; j < l.w*l.h*l.n; ++j) p->probs[j] = calloc(l.classes+1, sizeof(float));
+
+    open_frame_source(&p->source, filename, w, h);
+    p->input = calloc(p->batch*p->net.inputs, sizeof(float));
+    p->nframes = PIPELINE_STAGES*PIPELINE_DEPTH*p->batch;
+    p->frames = calloc(p->nframes, sizeof(pipeline_frame));
+    for(i = 0; i < PIPELINE_STAGES - 1; ++i) init_queue(p->queues + i, PIPELINE_DEPTH*p->batch);
+    init_queue(p->queues + PIPELINE_STAGES - 1, p->nframes);
+    for(i = 0; i < p->nframes; ++i){
+        pipeline_frame *f = p->frames + i;
+        f->letter = make_image(p->net.w, p->net.h, 3);
+        f->prediction = calloc(l.outputs, sizeof(float));
+        push_frame(p->queues + PIPELINE_STAGES - 1, f);
+    }
+    pthread_mutex_init(&p->stats_mutex, 0);
+
+    fprintf(stderr, "Headless demo: %s, batch %d\n", filename, p->batch);
+    p->start = p->last_report = get_wall_time();
+    pthread_t threads[PIPELINE_STAGES];
+    for(i = 0; i < PIPELINE_STAGES; ++i){
+        stage_args *args = calloc(1, sizeof(stage_args));
+        args->p = p;
+        args->stage = i;
+        if(pthread_create(threads + i, 0, stage_thread, args)) error("Thread creation failed");
+    }
+    for(i = 0; i < PIPELINE_STAGES; ++i) pthread_join(threads[i], 0);
+    print_pipeline_stats(p, get_wall_time());
+
+    for(i = 0; i < p->nframes; ++i){
+        free_image(p->frames[i].im);
+        free_image(p->frames[i].letter);
+        free(p->frames[i].prediction);
+    }
+    free(p->frames);
+    free(p->input);
+    if(p->json && p->json != stdout) fclose(p->json);
+    else if(p->json) fflush(stdout);
+    for(i = 0; i < PIPELINE_STAGES; ++i) free_queue(p->queues + i);
+    pthread_mutex_destroy(&p->stats_mutex);
+    close_frame_source(&p->source);
+    for(j = 0; j < l.w*l.h*l.n; ++j) free(p->probs[j]);
+    free(p->probs);
+    free(p->boxes);
+    free_tracker(p->tracker);
+    free(p->ids);
+    free(p->avg);
+    for(j = 0; j < p->avg_frames; ++j) free(p->predictions[j]);
+    free(p->predictions);
+    free_network(p->net);
+    free(p);
+}
@@ -0,0 +1,6 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+void demo_pipeline(char *cfgfile, char *weightfile, float thresh, float hier, char *filename, char **names, int classes, char *prefix, char *outfile, int avg_frames, int track, int batch, int w, int h);
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "profiler.h"
+#include "network.h"
+#include "utils.h"
+
+profiler *make_profiler(network net, int trace)
+{
+    profiler *p = calloc(1, sizeof(profiler));
+    p->n = net.n;
+    p->time = calloc(net.n, sizeof(double));
+    p->calls = calloc(net.n, sizeof(int));
+    p->flops = calloc(net.n, sizeof(long));
+    p->bytes = calloc(net.n, sizeof(long));
+    p->trace = trace;
+    p->origin = get_wall_time();
+    return p;
+}
+
+void free_profiler(profiler *p)
+{
+    if(!p) return;
+    free(p->time);
+    free(p->calls);
+    free(p->flops);
+    free(p->bytes);
+    free(p->event);
+    free(p);
+}
+
+void reset_profiler(profiler *p)
+{
+    int i;
+    for(i = 0; i < p->n; ++i){
+        p->time[i] = 0;
+        p->calls[i] = 0;
+        p->flops[i] = 0;
+        p->bytes[i] = 0;
+    }
+    p->passes = 0;
+    p->events = 0;
+    p->origin = get_wall_time();
+}
+
+long layer_flops(layer l)
+{
+    long ops = 0;
+    switch(l.type){
+        case CONVOLUTIONAL:
+        case DECONVOLUTIONAL:
+            ops = 2l * l.nweights * (l.type == CONVOLUTIONAL ? l.out_h*l.out_w : l.h*l.w);
+            break;
+        case LOCAL:
+            ops = 2l * l.n * l.size*l.size*l.c * l.out_h*l.out_w;
+            break;
+        case CONNECTED:
+            ops = 2l * l.inputs * l.outputs;
+            break;
+        case MAXPOOL:
+            ops = (long)l.size*l.size * l.outputs;
+            break;
+        case NORMALIZATION:
+            ops = 2l * l.size * l.outputs;
+            break;
+        case BATCHNORM:
+        case SOFTMAX:
+            ops = 3l * l.outputs;
+            break;
+        case AVGPOOL:
+        case COST:
+            ops = l.inputs;
+            break;
+        case ROUTE:
+        case REORG:
+        case CROP:
+            ops = 0;
+            break;
+        default:
+            ops = l.outputs;
+    }
+    return ops * l.batch;
+}
+
+long layer_bytes(layer l)
+{
+    long floats = (long)(l.inputs + l.outputs) * l.batch;
+    switch(l.type){
+        case CONVOLUTIONAL:
+        case DECONVOLUTIONAL:
+            floats += l.nweights + l.n;
+            break;
+        case LOCAL:
+            floats += (long)l.out_w*l.out_h*l.size*l.size*l.c*l.n + l.outputs;
+            break;
+        case CONNECTED:
+            floats += (long)l.inputs*l.outputs + l.outputs;
+            break;
+        case SHORTCUT:
+            floats += (long)l.outputs * l.batch;
+            break;
+        default:
+            break;
+    }
+    return floats * sizeof(float);
+}
+
+void profile_layer(profiler *p, layer l, int i, double start, double end)
+{
+    p->time[i] += end - start;
+    p->calls[i] += 1;
+    p->flops[i] += layer_flops(l);
+    p->bytes[i] += layer_bytes(l);
+    if(i == p->n - 1) ++p->passes;
+    if(!p->trace) return;
+    if(p->events == p->max_events){
+        p->max_events = p->max_events ? 2*p->max_events : 1024;
+        p->event = realloc(p->event, p->max_events*sizeof(profile_event));
+    }
+    profile_event e = {i, start - p->origin, end - start};
+    p->event[p->events++] = e;
+}
+
+void print_profiler(network net)
+{
+    profiler *p = net.prof;
+    if(!p) return;
+    int i;
+    double total = 0;
+    long flops = 0;
+    for(i = 0; i < p->n; ++i){
+        total += p->time[i];
+        flops += p->flops[i];
+    }
+    int passes = p->passes ? p->passes : 1;
+    fprintf(stderr, "layer           type  calls    ms/call  share     MFLOP/call   GFLOP/s     MB/call      GB/s\n");
+    for(i = 0; i < p->n; ++i){
+        if(!p->calls[i]) continue;
+        double t = p->time[i];
+        double per = t / p->calls[i];
+        fprintf(stderr, "%5d %14s %6d %10.3f %5.1f%% %14.2f %9.2f %11.2f %9.2f\n", i, get_layer_string(net.layers[i].type),
+                p->calls[i], 1000*per, t ? 100*t/total : 0,
+                p->flops[i]/1e6/p->calls[i], t ? p->flops[i]/t/1e9 : 0,
+                p->bytes[i]/1e6/p->calls[i], t ? p->bytes[i]/t/1e9 : 0);
+    }
+    fprintf(stderr, "total: %d passes, %.3f ms/pass, %.2f GFLOP/pass, %.2f GFLOP/s\n", p->passes,
+            1000*total/passes, flops/1e9/passes, total ? flops/total/1e9 : 0);
+}
+
+void save_profiler_trace(network net, char *filename)
+{
+    profiler *p = net.prof;
+    if(!p) return;
+    FILE *fp = fopen(filename, "w");
+    if(!fp) file_error(filename);
+    int i;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for(i = 0; i < p->events; ++i){
+        profile_event e = p->event[i];
+        layer l = net.layers[e.layer];
+        fprintf(fp, "{\"name\":\"%d %s\",\"cat\":\"layer\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"flops\":%ld,\"bytes\":%ld}}%s\n",
+                e.layer, get_layer_string(l.type), e.start*1e6, e.dur*1e6, layer_flops(l), layer_bytes(l), (i < p->events-1) ? "," : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+}
@@ -0,0 +1,36 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "layer.h"
+
+typedef struct{
+    int layer;
+    double start;
+    double dur;
+} profile_event;
+
+typedef struct profiler{
+    int n;
+    int passes;
+    double *time;
+    int *calls;
+    long *flops;
+    long *bytes;
+
+    int trace;
+    int events;
+    int max_events;
+    double origin;
+    profile_event *event;
+} profiler;
+
+profiler *make_profiler(network net, int trace);
+void free_profiler(profiler *p);
+void reset_profiler(profiler *p);
+void profile_layer(profiler *p, layer l, int i, double start, double end);
+long layer_flops(layer l);
+long layer_bytes(layer l);
+void print_profiler(network net);
+void save_profiler_trace(network net, char *filename);
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "quantize.h"
+#include "mapped_weights.h"
+#include "activations.h"
+#include "parser.h"
+#include "image.h"
+#include "data.h"
+#include "utils.h"
+
+/* Weight rows and im2row patches are zero padded to a whole number of SIMD registers. */
+#define QUANT_ALIGN 32
+
+int quantized_row_size(int k)
+{
+    return (k + QUANT_ALIGN - 1) / QUANT_ALIGN * QUANT_ALIGN;
+}
+
+static int quantized_rows(layer l)
+{
+    return l.type == CONNECTED ? l.outputs : l.n;
+}
+
+static int quantized_cols(layer l)
+{
+    return l.type == CONNECTED ? l.inputs : l.size*l.size*l.c;
+}
+
+size_t quantized_workspace_size(layer l)
+{
+    size_t kp = quantized_row_size(quantized_cols(l));
+    if(l.type == CONNECTED) return l.batch*kp;
+    return l.out_w*l.out_h*kp + l.c*l.h*l.w;
+}
+
+void enable_quantized_layer(network *net, layer *l)
+{
+    if(l->type != CONVOLUTIONAL && l->type != CONNECTED) error("Only convolutional and connected layers can be quantized");
+    if(l->binary || l->xnor) error("Binary layers can not be quantized");
+    if(l->type == CONVOLUTIONAL && l->groups > 1) error("Grouped convolutions can not be quantized");
+#ifdef GPU
+    if(gpu_index >= 0) error("INT8 inference is CPU only");
+#endif
+    free(l->weights);
+    l->weights = 0;
+    l->quantized = 1;
+    reserve_layer_workspace(net, l, quantized_workspace_size(*l));
+}
+
+static void quantize_array(float *x, int n, float scale, signed char *q)
+{
+    int i;
+    float inv = 1./scale;
+    for(i = 0; i < n; ++i){
+        float v = x[i]*inv;
+        v = v > 127 ? 127 : (v < -127 ? -127 : v);
+        q[i] = (signed char)lrintf(v);
+    }
+}
+
+static void im2row_int8(signed char *im, int c, int h, int w, int size, int stride, int pad,
+        int out_h, int out_w, int kp, signed char *rows)
+{
+    int x, y, ch, i, j;
+    for(y = 0; y < out_h; ++y){
+        for(x = 0; x < out_w; ++x){
+            signed char *row = rows + ((size_t)y*out_w + x)*kp;
+            int k = 0;
+            for(ch = 0; ch < c; ++ch){
+                for(i = 0; i < size; ++i){
+                    int iy = y*stride + i - pad;
+                    for(j = 0; j < size; ++j){
+                        int ix = x*stride + j - pad;
+                        row[k++] = (iy >= 0 && iy < h && ix >= 0 && ix < w) ? im[(ch*h + iy)*w + ix] : 0;
+                    }
+                }
+            }
+            memset(row + k, 0, kp - k);
+        }
+    }
+}
+
+#ifdef __AVX2__
+/* |a| * (b * sign(a)) keeps the u8 x s8 product form the madd instructions want;
+   quantized values stay in [-127, 127] so the 16 bit pair sums can not saturate. */
+static inline __m256i dot_step(__m256i acc, __m256i a, __m256i b)
+{
+    __m256i ua = _mm256_sign_epi8(a, a);
+    __m256i sb = _mm256_sign_epi8(b, a);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32(acc, ua, sb);
+#elif defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(acc, ua, sb);
+#else
+    __m256i p = _mm256_maddubs_epi16(ua, sb);
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(p, _mm256_set1_epi16(1)));
+#endif
+}
+
+static inline int hsum_epi32(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+static int dot_int8(signed char *a, signed char *b, int kp)
+{
+    int i;
+    __m256i s = _mm256_setzero_si256();
+    for(i = 0; i < kp; i += 32){
+        s = dot_step(s, _mm256_loadu_si256((__m256i *)(a + i)), _mm256_loadu_si256((__m256i *)(b + i)));
+    }
+    return hsum_epi32(s);
+}
+
+static void dot4_int8(signed char *a, int kp, signed char *b, int *out)
+{
+    int i;
+    __m256i s0 = _mm256_setzero_si256();
+    __m256i s1 = s0, s2 = s0, s3 = s0;
+    for(i = 0; i < kp; i += 32){
+        __m256i vb = _mm256_loadu_si256((__m256i *)(b + i));
+        s0 = dot_step(s0, _mm256_loadu_si256((__m256i *)(a + i)), vb);
+        s1 = dot_step(s1, _mm256_loadu_si256((__m256i *)(a + kp + i)), vb);
+        s2 = dot_step(s2, _mm256_loadu_si256((__m256i *)(a + 2*kp + i)), vb);
+        s3 = dot_step(s3, _mm256_loadu_si256((__m256i *)(a + 3*kp + i)), vb);
+    }
+    out[0] = hsum_epi32(s0);
+    out[1] = hsum_epi32(s1);
+    out[2] = hsum_epi32(s2);
+    out[3] = hsum_epi32(s3);
+}
+#else
+static int dot_int8(signed char *a, signed char *b, int kp)
+{
+    int i;
+    int s = 0;
+    for(i = 0; i < kp; ++i) s += a[i]*b[i];
+    return s;
+}
+
+static void dot4_int8(signed char *a, int kp, signed char *b, int *out)
+{
+    int j;
+    for(j = 0; j < 4; ++j) out[j] = dot_int8(a + j*kp, b, kp);
+}
+#endif
+
+/* out[f*fs + p*ps] = act(scale[f] * (a[f] . b[p]) + bias[f]), requantized straight from the int32 sums. */
+static void gemm_int8_fused(int m, int n, int kp, signed char *a, signed char *b,
+        float in_scale, float *wscales, float *biases, ACTIVATION act, float *out, int fs, int ps)
+{
+    int f, p, j;
+    int acc[4];
+    for(f = 0; f < m; f += 4){
+        int nf = (m - f < 4) ? m - f : 4;
+        for(p = 0; p < n; ++p){
+            signed char *row = b + (size_t)p*kp;
+            if(nf == 4) dot4_int8(a + (size_t)f*kp, kp, row, acc);
+            else for(j = 0; j < nf; ++j) acc[j] = dot_int8(a + (size_t)(f+j)*kp, row, kp);
+            for(j = 0; j < nf; ++j){
+                float v = acc[j]*in_scale*wscales[f+j] + biases[f+j];
+                if(act == LEAKY) v = (v > 0) ? v : .1f*v;
+                else if(act == RELU) v = (v > 0) ? v : 0;
+                else if(act != LINEAR) v = activate(v, act);
+                out[(size_t)(f+j)*fs + (size_t)p*ps] = v;
+            }
+        }
+    }
+}
+
+void forward_quantized_layer(layer l, network net)
+{
+    int b;
+    int kp = quantized_row_size(quantized_cols(l));
+    float scale = l.qscales[0];
+    signed char *rows = (signed char *)net.workspace;
+    if(l.type == CONNECTED){
+        for(b = 0; b < l.batch; ++b){
+            signed char *row = rows + (size_t)b*kp;
+            quantize_array(net.input + b*l.inputs, l.inputs, scale, row);
+            memset(row + l.inputs, 0, kp - l.inputs);
+        }
+        gemm_int8_fused(l.outputs, l.batch, kp, l.qweights, rows, scale, l.qscales + 1, l.biases, l.activation, l.output, 1, l.outputs);
+        return;
+    }
+    int n = l.out_w*l.out_h;
+    signed char *q = rows + (size_t)n*kp;
+    for(b = 0; b < l.batch; ++b){
+        quantize_array(net.input + b*l.inputs, l.inputs, scale, q);
+        im2row_int8(q, l.c, l.h, l.w, l.size, l.stride, l.pad, l.out_h, l.out_w, kp, rows);
+        gemm_int8_fused(l.n, n, kp, l.qweights, rows, scale, l.qscales + 1, l.biases, l.activation, l.output + b*l.outputs, n, 1);
+    }
+}
+
+static int quantizable(layer l)
+{
+    if(l.type == CONVOLUTIONAL) return !l.binary && !l.xnor && l.groups == 1;
+    return l.type == CONNECTED;
+}
+
+static float max_abs(float *x, int n)
+{
+    int i;
+    float m = 0;
+    for(i = 0; i < n; ++i) if(fabsf(x[i]) > m) m = fabsf(x[i]);
+    return m;
+}
+
+static void calibrate_forward(network net, float *input, float *ranges)
+{
+    int i;
+    net.input = input;
+    net.truth = 0;
+    net.train = 0;
+    net.delta = 0;
+    for(i = 0; i < net.n; ++i){
+        net.index = i;
+        layer l = net.layers[i];
+        if(quantizable(l)){
+            float m = max_abs(net.input, l.inputs*l.batch);
+            if(m > ranges[i]) ranges[i] = m;
+        }
+        l.forward(l, net);
+        net.input = l.output;
+        if(l.truth) net.truth = l.output;
+    }
+}
+
+/* Batchnorm is folded into the weights and biases, then every output gets its own symmetric scale. */
+static void quantize_layer(network *net, layer *l, float range)
+{
+    int f, i;
+    int m = quantized_rows(*l);
+    int k = quantized_cols(*l);
+    int kp = quantized_row_size(k);
+    signed char *q = calloc((size_t)m*kp, sizeof(signed char));
+    float *scales = calloc(m + 1, sizeof(float));
+    scales[0] = range > 0 ? range/127 : 1;
+    for(f = 0; f < m; ++f){
+        float s = 1;
+        if(l->batch_normalize){
+            s = l->scales[f]/sqrt(l->rolling_variance[f] + .000001f);
+            l->biases[f] -= l->rolling_mean[f]*s;
+        }
+        float *w = l->weights + (size_t)f*k;
+        float most = 0;
+        for(i = 0; i < k; ++i) if(fabsf(w[i]*s) > most) most = fabsf(w[i]*s);
+        float ws = most > 0 ? most/127 : 1;
+        for(i = 0; i < k; ++i) q[(size_t)f*kp + i] = (signed char)lrintf(w[i]*s/ws);
+        scales[f + 1] = ws;
+    }
+    enable_quantized_layer(net, l);
+    l->qweights = q;
+    l->qscales = scales;
+}
+
+void quantize_network(char *cfgfile, char *weightfile, char *listfile, char *outfile, int samples)
+{
+    int i;
+    gpu_index = -1;
+    if(is_mapped_weights(weightfile)) error("Quantize expects legacy .weights");
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
+    load_weights(&net, weightfile);
+    set_batch_network(&net, 1);
+
+    list *plist = get_paths(listfile);
+    char **paths = (char **)list_to_array(plist);
+    int m = plist->size;
+    if(samples < 1 || samples > m) samples = m;
+    if(!samples) error("No calibration images");
+
+    float *ranges = calloc(net.n, sizeof(float));
+    for(i = 0; i < samples; ++i){
+        image im = load_image_color(paths[(size_t)i*m/samples], 0, 0);
+        image sized = letterbox_image(im, net.w, net.h);
+        calibrate_forward(net, sized.data, ranges);
+        free_image(im);
+        free_image(sized);
+    }
+    fprintf(stderr, "Calibrated on %d images\n", samples);
+
+    size_t before = 0, after = 0;
+    for(i = 0; i < net.n; ++i){
+        layer *l = net.layers + i;
+        if(!quantizable(*l)) continue;
+        size_t count = (size_t)quantized_rows(*l)*quantized_cols(*l);
+        quantize_layer(&net, l, ranges[i]);
+        before += count*sizeof(float);
+        after += (size_t)quantized_rows(*l)*quantized_row_size(quantized_cols(*l));
+        fprintf(stderr, "%5d %-14s range %10.4f\n", i, get_layer_string(l->type), ranges[i]);
+    }
+    fprintf(stderr, "Weights %.2f MB -> %.2f MB\n", before/1e6, after/1e6);
+    save_mapped_weights(net, outfile);
+
+    free(ranges);
+    free(paths);
+    free_list_contents(plist);
+    free_list(plist);
+    free_network(net);
+}
@@ -0,0 +1,12 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "network.h"
+
+int quantized_row_size(int k);
+size_t quantized_workspace_size(layer l);
+void enable_quantized_layer(network *net, layer *l);
+void forward_quantized_layer(layer l, network net);
+void quantize_network(char *cfgfile, char *weightfile, char *listfile, char *outfile, int samples);
+
+#endif
@@ -4,7 +4,7 @@
 #include "layer.h"
 #include "network.h"
 
-layer make_region_layer(int batch, int h, int w, int n, int classes, int coords);
+layer make_region_layer(int batch, int h, int w, int n, int classes, int coords, int train);
 void forward_region_layer(const layer l, network net);
 void backward_region_layer(const layer l, network net);
 void get_region_boxes(layer l, int w, int h, int netw, int neth, float thresh, float **probs, box *boxes, int only_objectness, int *map, float tree_thresh, int relative);
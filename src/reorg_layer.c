@@ -4,7 +4,7 @@
 #include <stdio.h>
 
 
-layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse, int flatten, int extra)
+layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse, int flatten, int extra, int train)
 {
     layer l = {0};
     l.type = REORG;
@@ -40,7 +40,7 @@ layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse,
     }
     int output_size = l.outputs * batch;
     l.output =  calloc(output_size, sizeof(float));
-    l.delta =   calloc(output_size, sizeof(float));
+    if(train) l.delta = calloc(output_size, sizeof(float));
 
     l.forward = forward_reorg_layer;
     l.backward = backward_reorg_layer;
@@ -49,7 +49,7 @@ layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse,
     l.backward_gpu = backward_reorg_layer_gpu;
 
     l.output_gpu  = cuda_make_array(l.output, output_size);
-    l.delta_gpu   = cuda_make_array(l.delta, output_size);
+    if(train) l.delta_gpu   = cuda_make_array(l.delta, output_size);
 #endif
     return l;
 }
@@ -77,13 +77,13 @@ void resize_reorg_layer(layer *l, int w, int h)
     int output_size = l->outputs * l->batch;
 
     l->output = realloc(l->output, output_size * sizeof(float));
-    l->delta = realloc(l->delta, output_size * sizeof(float));
+    if(l->delta) l->delta = realloc(l->delta, output_size * sizeof(float));
 
 #ifdef GPU
     cuda_free(l->output_gpu);
     cuda_free(l->delta_gpu);
     l->output_gpu  = cuda_make_array(l->output, output_size);
-    l->delta_gpu   = cuda_make_array(l->delta,  output_size);
+    if(l->delta) l->delta_gpu   = cuda_make_array(l->delta,  output_size);
 #endif
 }
 
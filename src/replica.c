@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "replica.h"
+#include "mapped_weights.h"
+#include "blas.h"
+#include "utils.h"
+
+typedef struct {
+    network net;
+    data d;
+    float *err;
+} replica_args;
+
+typedef struct {
+    network *nets;
+    int n;
+    int part;
+} reduce_args;
+
+/* Weights and the per-output parameters (biases, scales, rolling statistics) of a trainable layer. */
+void layer_param_sizes(layer l, int *nweights, int *noutputs)
+{
+    *nweights = *noutputs = 0;
+    if(l.type == CONVOLUTIONAL || l.type == DECONVOLUTIONAL){
+        *nweights = l.nweights;
+        *noutputs = l.n;
+    } else if(l.type == CONNECTED){
+        *nweights = l.inputs*l.outputs;
+        *noutputs = l.outputs;
+    } else if(l.type == LOCAL){
+        *nweights = l.size*l.size*l.c*l.n*l.out_w*l.out_h;
+        *noutputs = l.outputs;
+    } else if(l.type == BATCHNORM){
+        *noutputs = l.c;
+    } else if(l.update){
+        fprintf(stderr, "%s layers can not be trained as replicas\n", get_layer_string(l.type));
+        error("Unsupported replica layer");
+    }
+}
+
+static void share_array(network *net, float **x, float *base)
+{
+    if(!*x) return;
+    if(!is_mapped_pointer(net, *x)) free(*x);
+    *x = base;
+}
+
+/* Every replica after the first drops its own weights and trains on the first replica's copy.
+   Rolling statistics stay per replica and are averaged after each step. */
+void share_network_weights(network *nets, int n)
+{
+    int i, j;
+    for(i = 1; i < n; ++i){
+        for(j = 0; j < nets[i].n; ++j){
+            layer *l = nets[i].layers + j;
+            layer base = nets[0].layers[j];
+            int nweights, noutputs;
+            layer_param_sizes(*l, &nweights, &noutputs);
+            if(nweights) share_array(nets + i, &l->weights, base.weights);
+            if(noutputs){
+                share_array(nets + i, &l->biases, base.biases);
+                share_array(nets + i, &l->scales, base.scales);
+            }
+        }
+    }
+}
+
+static void *train_replica_thread(void *ptr)
+{
+    replica_args args = *(replica_args *)ptr;
+    free(ptr);
+    network net = args.net;
+    int batch = net.batch;
+    int n = args.d.X.rows / batch;
+    int i;
+    float sum = 0;
+    net.train = 1;
+    for(i = 0; i < n; ++i){
+        get_next_batch(args.d, batch, i*batch, net.input, net.truth);
+        *net.seen += batch;
+        forward_network(net);
+        backward_network(net);
+        sum += *net.cost;
+    }
+    *args.err = sum/(n*batch);
+    return 0;
+}
+
+static void part_range(int size, int part, int parts, int *start, int *end)
+{
+    *start = (int)((long long)size*part/parts);
+    *end = (int)((long long)size*(part + 1)/parts);
+}
+
+/* Sums slice part of every replica's updates into the first replica and clears them. */
+static void reduce_updates(network *nets, int n, int part, int j, float *(*field)(layer), int size)
+{
+    int i, s, e;
+    float *sum = field(nets[0].layers[j]);
+    if(!sum) return;
+    part_range(size, part, n, &s, &e);
+    for(i = 1; i < n; ++i){
+        float *x = field(nets[i].layers[j]);
+        axpy_cpu(e - s, 1, x + s, 1, sum + s, 1);
+        fill_cpu(e - s, 0, x + s, 1);
+    }
+}
+
+static void average_statistics(network *nets, int n, int part, int j, float *(*field)(layer), int size)
+{
+    int i, s, e;
+    float *mean = field(nets[0].layers[j]);
+    if(!mean) return;
+    part_range(size, part, n, &s, &e);
+    for(i = 1; i < n; ++i) axpy_cpu(e - s, 1, field(nets[i].layers[j]) + s, 1, mean + s, 1);
+    scal_cpu(e - s, 1./n, mean + s, 1);
+    for(i = 1; i < n; ++i) copy_cpu(e - s, mean + s, 1, field(nets[i].layers[j]) + s, 1);
+}
+
+static float *weight_updates_of(layer l) { return l.weight_updates; }
+static float *bias_updates_of(layer l) { return l.bias_updates; }
+static float *scale_updates_of(layer l) { return l.scale_updates; }
+static float *rolling_mean_of(layer l) { return l.rolling_mean; }
+static float *rolling_variance_of(layer l) { return l.rolling_variance; }
+
+static void *reduce_replica_thread(void *ptr)
+{
+    reduce_args args = *(reduce_args *)ptr;
+    free(ptr);
+    int j;
+    for(j = 0; j < args.nets[0].n; ++j){
+        int nweights, noutputs;
+        layer_param_sizes(args.nets[0].layers[j], &nweights, &noutputs);
+        if(nweights) reduce_updates(args.nets, args.n, args.part, j, weight_updates_of, nweights);
+        if(!noutputs) continue;
+        reduce_updates(args.nets, args.n, args.part, j, bias_updates_of, noutputs);
+        reduce_updates(args.nets, args.n, args.part, j, scale_updates_of, noutputs);
+        average_statistics(args.nets, args.n, args.part, j, rolling_mean_of, noutputs);
+        average_statistics(args.nets, args.n, args.part, j, rolling_variance_of, noutputs);
+    }
+    return 0;
+}
+
+static void run_replica_threads(int n, void *(*func)(void *), void **args)
+{
+    int i;
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    for(i = 0; i < n; ++i){
+        if(pthread_create(threads + i, 0, func, args[i])) error("Thread creation failed");
+    }
+    for(i = 0; i < n; ++i) pthread_join(threads[i], 0);
+    free(threads);
+}
+
+/* Each replica trains on its share of d in its own thread, then the gradients are summed into
+   the first replica, which applies one update for all n*batch*subdivisions images. */
+float train_network_replicas(network *nets, int n, data d)
+{
+    int i;
+    network net = nets[0];
+    assert(net.batch * net.subdivisions * n == d.X.rows);
+    float *errors = calloc(n, sizeof(float));
+    void **args = calloc(n, sizeof(void *));
+
+    for(i = 0; i < n; ++i){
+        replica_args *ptr = calloc(1, sizeof(replica_args));
+        ptr->net = nets[i];
+        ptr->d = get_data_part(d, i, n);
+        ptr->err = errors + i;
+        args[i] = ptr;
+    }
+    run_replica_threads(n, train_replica_thread, args);
+
+    for(i = 0; i < n; ++i){
+        reduce_args *ptr = calloc(1, sizeof(reduce_args));
+        ptr->nets = nets;
+        ptr->n = n;
+        ptr->part = i;
+        args[i] = ptr;
+    }
+    run_replica_threads(n, reduce_replica_thread, args);
+
+    *net.seen += (n-1) * net.batch * net.subdivisions;
+    for(i = 1; i < n; ++i) *nets[i].seen = *net.seen;
+
+    int update_batch = net.batch*net.subdivisions*n;
+    float rate = get_current_rate(net);
+    for(i = 0; i < net.n; ++i){
+        layer l = net.layers[i];
+        if(l.update){
+            l.update(l, update_batch, rate*l.learning_rate_scale, net.momentum, net.decay);
+        }
+    }
+
+    float sum = 0;
+    for(i = 0; i < n; ++i) sum += errors[i];
+    free(errors);
+    free(args);
+    return sum/n;
+}
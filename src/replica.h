@@ -0,0 +1,10 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include "network.h"
+
+void layer_param_sizes(layer l, int *nweights, int *noutputs);
+void share_network_weights(network *nets, int n);
+float train_network_replicas(network *nets, int n, data d);
+
+#endif
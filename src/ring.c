@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ring.h"
+#include "replica.h"
+#include "blas.h"
+#include "utils.h"
+
+/* Seconds to keep retrying the next peer while the other processes start. */
+#define RING_CONNECT_TIMEOUT 60
+
+static char *ring_peer(char *peers, int index, char *host, int size, int *port)
+{
+    char *p = peers;
+    int i;
+    for(i = 0; i < index && p; ++i){
+        p = strchr(p, ',');
+        if(p) ++p;
+    }
+    if(!p || !*p) error("Ring rank is outside the peer list");
+    int len = strcspn(p, ",");
+    char *colon = memchr(p, ':', len);
+    if(!colon) error("Ring peers must be host:port");
+    int hlen = colon - p;
+    if(hlen >= size) hlen = size - 1;
+    memcpy(host, p, hlen);
+    host[hlen] = 0;
+    *port = atoi(colon + 1);
+    return p;
+}
+
+static void full_write(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while(n){
+        ssize_t k = write(fd, p, n);
+        if(k < 0 && errno == EINTR) continue;
+        if(k <= 0) error("Ring connection lost");
+        p += k;
+        n -= k;
+    }
+}
+
+static void full_read(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while(n){
+        ssize_t k = read(fd, p, n);
+        if(k < 0 && errno == EINTR) continue;
+        if(k <= 0) error("Ring connection lost");
+        p += k;
+        n -= k;
+    }
+}
+
+static int ring_listen(int port)
+{
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0) error("Couldn't open ring socket");
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) error("Couldn't bind ring port");
+    if(listen(fd, 1) < 0) error("Couldn't listen on ring port");
+    return fd;
+}
+
+static int ring_connect(char *host, int port)
+{
+    char service[16];
+    sprintf(service, "%d", port);
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host, service, &hints, &res)) error("Couldn't resolve ring peer");
+    int tries;
+    for(tries = 0; tries < RING_CONNECT_TIMEOUT*10; ++tries){
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0) error("Couldn't open ring socket");
+        if(connect(fd, res->ai_addr, res->ai_addrlen) == 0){
+            freeaddrinfo(res);
+            return fd;
+        }
+        close(fd);
+        usleep(100000);
+    }
+    fprintf(stderr, "Couldn't reach ring peer %s:%d\n", host, port);
+    error("Ring connect timed out");
+    return -1;
+}
+
+/* Every process listens on its own port, connects to the next rank and accepts the previous one.
+   Listening first means the connects complete from the backlog, so start order doesn't matter. */
+ring *make_ring(char *peers, int rank)
+{
+    char host[256];
+    int port, i;
+    ring *r = calloc(1, sizeof(ring));
+    r->rank = rank;
+    r->size = 1;
+    for(i = 0; peers[i]; ++i) if(peers[i] == ',') ++r->size;
+    if(rank < 0 || rank >= r->size) error("Ring rank is outside the peer list");
+    if(r->size == 1) return r;
+
+    ring_peer(peers, rank, host, sizeof(host), &port);
+    int server = ring_listen(port);
+    ring_peer(peers, (rank + 1) % r->size, host, sizeof(host), &port);
+    r->next = ring_connect(host, port);
+    full_write(r->next, &rank, sizeof(rank));
+    r->prev = accept(server, 0, 0);
+    if(r->prev < 0) error("Couldn't accept ring peer");
+    close(server);
+
+    int prev_rank;
+    full_read(r->prev, &prev_rank, sizeof(prev_rank));
+    if(prev_rank != (rank + r->size - 1) % r->size) error("Ring peers are out of order");
+    int one = 1;
+    setsockopt(r->next, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(r->prev, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fprintf(stderr, "Ring rank %d of %d connected\n", rank, r->size);
+    return r;
+}
+
+void free_ring(ring *r)
+{
+    if(!r) return;
+    if(r->size > 1){
+        close(r->next);
+        close(r->prev);
+    }
+    free(r);
+}
+
+/* Sends to the next rank while receiving from the previous one so neither side blocks on a full socket. */
+static void ring_exchange(ring *r, void *out, size_t out_bytes, void *in, size_t in_bytes)
+{
+    size_t sent = 0, got = 0;
+    while(sent < out_bytes || got < in_bytes){
+        struct pollfd fds[2];
+        fds[0].fd = r->next;
+        fds[0].events = (sent < out_bytes) ? POLLOUT : 0;
+        fds[1].fd = r->prev;
+        fds[1].events = (got < in_bytes) ? POLLIN : 0;
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR) continue;
+            error("Ring poll failed");
+        }
+        if(fds[0].revents & (POLLERR | POLLHUP) || fds[1].revents & POLLERR) error("Ring connection lost");
+        if(fds[0].revents & POLLOUT){
+            ssize_t k = send(r->next, (char *)out + sent, out_bytes - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(k < 0 && errno != EAGAIN && errno != EINTR) error("Ring connection lost");
+            if(k > 0) sent += k;
+        }
+        if(fds[1].revents & (POLLIN | POLLHUP)){
+            ssize_t k = recv(r->prev, (char *)in + got, in_bytes - got, MSG_DONTWAIT);
+            if(k == 0 || (k < 0 && errno != EAGAIN && errno != EINTR)) error("Ring connection lost");
+            if(k > 0) got += k;
+        }
+    }
+}
+
+static size_t ring_chunk(size_t n, int size, int c, size_t *start)
+{
+    c = ((c % size) + size) % size;
+    *start = n*c/size;
+    return n*(c + 1)/size - *start;
+}
+
+/* Sum of x over all ranks: a reduce-scatter then an all-gather, each moving one chunk per step. */
+void ring_allreduce(ring *r, float *x, size_t n)
+{
+    int s;
+    if(r->size == 1) return;
+    float *tmp = calloc(n/r->size + 1, sizeof(float));
+    for(s = 0; s < r->size - 1; ++s){
+        size_t out_start, in_start;
+        size_t out_n = ring_chunk(n, r->size, r->rank - s, &out_start);
+        size_t in_n = ring_chunk(n, r->size, r->rank - s - 1, &in_start);
+        ring_exchange(r, x + out_start, out_n*sizeof(float), tmp, in_n*sizeof(float));
+        axpy_cpu(in_n, 1, tmp, 1, x + in_start, 1);
+    }
+    for(s = 0; s < r->size - 1; ++s){
+        size_t out_start, in_start;
+        size_t out_n = ring_chunk(n, r->size, r->rank + 1 - s, &out_start);
+        size_t in_n = ring_chunk(n, r->size, r->rank - s, &in_start);
+        ring_exchange(r, x + out_start, out_n*sizeof(float), x + in_start, in_n*sizeof(float));
+    }
+    free(tmp);
+}
+
+/* Every size-th path starting at rank, sharing the strings of paths. */
+char **ring_shard_paths(ring *r, char **paths, int *n)
+{
+    int i, m = 0;
+    char **shard = calloc(*n/r->size + 1, sizeof(char *));
+    for(i = r->rank; i < *n; i += r->size) shard[m++] = paths[i];
+    if(!m) error("Ring has more ranks than training images");
+    *n = m;
+    return shard;
+}
+
+static size_t ring_pack(network net, float *buf, int unpack)
+{
+    size_t k = 0;
+    int j;
+    for(j = 0; j < net.n; ++j){
+        layer l = net.layers[j];
+        int nweights, noutputs;
+        layer_param_sizes(l, &nweights, &noutputs);
+        float *arrays[5] = {nweights ? l.weights : 0, l.biases, l.scales, l.rolling_mean, l.rolling_variance};
+        int sizes[5] = {nweights, noutputs, noutputs, noutputs, noutputs};
+        int a;
+        for(a = 0; a < 5; ++a){
+            if(!arrays[a] || !sizes[a]) continue;
+            if(buf && unpack) memcpy(arrays[a], buf + k, sizes[a]*sizeof(float));
+            else if(buf) memcpy(buf + k, arrays[a], sizes[a]*sizeof(float));
+            k += sizes[a];
+        }
+    }
+    return k;
+}
+
+/* sync_nets across processes: the weights of every rank are replaced by their average. */
+void sync_ring(ring *r, network *nets, int n, int interval)
+{
+    int i, j;
+    network net = nets[0];
+#ifdef GPU
+    if(gpu_index >= 0) error("Ring training is CPU only");
+#endif
+    *net.seen += interval * (r->size-1) * net.batch * net.subdivisions * n;
+    for(i = 1; i < n; ++i) *nets[i].seen = *net.seen;
+    if(r->size == 1) return;
+
+    size_t total = ring_pack(net, 0, 0);
+    float *buf = calloc(total, sizeof(float));
+    ring_pack(net, buf, 0);
+    ring_allreduce(r, buf, total);
+    scal_cpu(total, 1./r->size, buf, 1);
+    ring_pack(net, buf, 1);
+    free(buf);
+
+    for(i = 1; i < n; ++i){
+        for(j = 0; j < net.n; ++j){
+            layer base = net.layers[j];
+            layer l = nets[i].layers[j];
+            int nweights, noutputs;
+            layer_param_sizes(base, &nweights, &noutputs);
+            if(l.rolling_mean) copy_cpu(noutputs, base.rolling_mean, 1, l.rolling_mean, 1);
+            if(l.rolling_variance) copy_cpu(noutputs, base.rolling_variance, 1, l.rolling_variance, 1);
+        }
+    }
+}
+
+/* darknet ring <n> [-port p] <command...> runs the command as n local ranks. */
+void run_ring(int argc, char **argv)
+{
+    if(argc < 4){
+        fprintf(stderr, "usage: %s ring <processes> [-port base] <darknet command...>\n", argv[0]);
+        return;
+    }
+    int port = find_int_arg(argc, argv, "-port", 9300);
+    int n = atoi(argv[2]);
+    int i, j;
+    if(n < 1) error("Ring needs at least one process");
+
+    char *peers = calloc(n*32, sizeof(char));
+    for(i = 0; i < n; ++i){
+        sprintf(peers + strlen(peers), "%s127.0.0.1:%d", i ? "," : "", port + i);
+    }
+    pid_t *pids = calloc(n, sizeof(pid_t));
+    for(i = 0; i < n; ++i){
+        pids[i] = fork();
+        if(pids[i] < 0) error("Couldn't fork ring process");
+        if(pids[i]) continue;
+        char rank[16];
+        sprintf(rank, "%d", i);
+        char **args = calloc(argc + 4, sizeof(char *));
+        int k = 0;
+        args[k++] = argv[0];
+        for(j = 3; j < argc; ++j) if(argv[j]) args[k++] = argv[j];
+        args[k++] = "-ring";
+        args[k++] = peers;
+        args[k++] = "-rank";
+        args[k++] = rank;
+        execv(argv[0], args);
+        perror(argv[0]);
+        _exit(1);
+    }
+    int failed = 0;
+    for(i = 0; i < n; ++i){
+        int status;
+        waitpid(pids[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status)){
+            fprintf(stderr, "Ring rank %d failed\n", i);
+            failed = 1;
+        }
+    }
+    free(pids);
+    free(peers);
+    if(failed) error("Ring training failed");
+}
@@ -0,0 +1,20 @@
+#ifndef RING_H
+#define RING_H
+
+#include "network.h"
+
+typedef struct {
+    int rank;
+    int size;
+    int next;
+    int prev;
+} ring;
+
+ring *make_ring(char *peers, int rank);
+void free_ring(ring *r);
+void ring_allreduce(ring *r, float *x, size_t n);
+char **ring_shard_paths(ring *r, char **paths, int *n);
+void sync_ring(ring *r, network *nets, int n, int interval);
+void run_ring(int argc, char **argv);
+
+#endif
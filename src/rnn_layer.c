@@ -41,17 +41,17 @@ layer make_rnn_layer(int batch, int inputs, int hidden, int outputs, int steps,
 
     l.input_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.input_layer) = make_connected_layer(batch*steps, inputs, hidden, activation, batch_normalize);
+    *(l.input_layer) = make_connected_layer(batch*steps, inputs, hidden, activation, batch_normalize, 1);
     l.input_layer->batch = batch;
 
     l.self_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.self_layer) = make_connected_layer(batch*steps, hidden, hidden, (log==2)?LOGGY:(log==1?LOGISTIC:activation), batch_normalize);
+    *(l.self_layer) = make_connected_layer(batch*steps, hidden, hidden, (log==2)?LOGGY:(log==1?LOGISTIC:activation), batch_normalize, 1);
     l.self_layer->batch = batch;
 
     l.output_layer = malloc(sizeof(layer));
     fprintf(stderr, "\t\t");
-    *(l.output_layer) = make_connected_layer(batch*steps, hidden, outputs, activation, batch_normalize);
+    *(l.output_layer) = make_connected_layer(batch*steps, hidden, outputs, activation, batch_normalize, 1);
     l.output_layer->batch = batch;
 
     l.outputs = outputs;
@@ -73,6 +73,30 @@ layer make_rnn_layer(int batch, int inputs, int hidden, int outputs, int steps,
     return l;
 }
 
+static void resize_step_layer(layer *s, int batch, int steps)
+{
+    s->batch = batch*steps;
+    resize_connected_layer(s, s->inputs);
+    s->batch = batch;
+}
+
+void resize_rnn_layer(layer *l, int inputs)
+{
+    if(inputs != l->inputs) error("RNN layer inputs cannot change size");
+    resize_step_layer(l->input_layer, l->batch, l->steps);
+    resize_step_layer(l->self_layer, l->batch, l->steps);
+    resize_step_layer(l->output_layer, l->batch, l->steps);
+    l->state = realloc(l->state, l->batch*l->hidden*(l->steps+1)*sizeof(float));
+    l->output = l->output_layer->output;
+    l->delta = l->output_layer->delta;
+#ifdef GPU
+    cuda_free(l->state_gpu);
+    l->state_gpu = cuda_make_array(l->state, l->batch*l->hidden*(l->steps+1));
+    l->output_gpu = l->output_layer->output_gpu;
+    l->delta_gpu = l->output_layer->delta_gpu;
+#endif
+}
+
 void update_rnn_layer(layer l, int batch, float learning_rate, float momentum, float decay)
 {
     update_connected_layer(*(l.input_layer), batch, learning_rate, momentum, decay);
@@ -12,6 +12,7 @@ layer make_rnn_layer(int batch, int inputs, int hidden, int outputs, int steps,
 void forward_rnn_layer(layer l, network net);
 void backward_rnn_layer(layer l, network net);
 void update_rnn_layer(layer l, int batch, float learning_rate, float momentum, float decay);
+void resize_rnn_layer(layer *l, int inputs);
 
 #ifdef GPU
 void forward_rnn_layer_gpu(layer l, network net);
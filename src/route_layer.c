@@ -3,7 +3,7 @@
 #include "blas.h"
 #include <stdio.h>
 
-route_layer make_route_layer(int batch, int n, int *input_layers, int *input_sizes)
+route_layer make_route_layer(int batch, int n, int *input_layers, int *input_sizes, int train)
 {
     fprintf(stderr,"route ");
     route_layer l = {0};
@@ -21,7 +21,7 @@ route_layer make_route_layer(int batch, int n, int *input_layers, int *input_siz
     fprintf(stderr, "\n");
     l.outputs = outputs;
     l.inputs = outputs;
-    l.delta =  calloc(outputs*batch, sizeof(float));
+    if(train) l.delta = calloc(outputs*batch, sizeof(float));
     l.output = calloc(outputs*batch, sizeof(float));;
 
     l.forward = forward_route_layer;
@@ -30,7 +30,7 @@ route_layer make_route_layer(int batch, int n, int *input_layers, int *input_siz
     l.forward_gpu = forward_route_layer_gpu;
     l.backward_gpu = backward_route_layer_gpu;
 
-    l.delta_gpu =  cuda_make_array(l.delta, outputs*batch);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, outputs*batch);
     l.output_gpu = cuda_make_array(l.output, outputs*batch);
     #endif
     return l;
@@ -58,18 +58,103 @@ void resize_route_layer(route_layer *l, network *net)
         }
     }
     l->inputs = l->outputs;
-    l->delta =  realloc(l->delta, l->outputs*l->batch*sizeof(float));
+    if(l->delta) l->delta = realloc(l->delta, l->outputs*l->batch*sizeof(float));
     l->output = realloc(l->output, l->outputs*l->batch*sizeof(float));
 
 #ifdef GPU
     cuda_free(l->output_gpu);
     cuda_free(l->delta_gpu);
     l->output_gpu  = cuda_make_array(l->output, l->outputs*l->batch);
-    l->delta_gpu   = cuda_make_array(l->delta,  l->outputs*l->batch);
+    if(l->delta) l->delta_gpu   = cuda_make_array(l->delta,  l->outputs*l->batch);
 #endif
 
 }
 
+static int viewable_layer(layer l)
+{
+    switch(l.type){
+        case CONVOLUTIONAL:
+        case DECONVOLUTIONAL:
+        case CONNECTED:
+        case LOCAL:
+        case MAXPOOL:
+        case AVGPOOL:
+        case ROUTE:
+        case SHORTCUT:
+        case REORG:
+        case ACTIVE:
+        case BATCHNORM:
+        case NORMALIZATION:
+        case SOFTMAX:
+        case CROP:
+            return l.batch == 1;
+        default:
+            return 0;
+    }
+}
+
+/* The first batch 1 route that concatenates layer index owns its output, or -1. */
+int route_output_owner(network *net, int index)
+{
+    int i, j;
+    if(!viewable_layer(net->layers[index])) return -1;
+    for(i = index + 1; i < net->n; ++i){
+        layer r = net->layers[i];
+        if(r.type != ROUTE || r.batch != 1) continue;
+        for(j = 0; j < r.n; ++j){
+            if(r.input_layers[j] == index) return i;
+        }
+    }
+    return -1;
+}
+
+/* With batch 1 each route input is written by its producer straight into the route's
+   output at its channel offset, so concatenation copies nothing. Routes are placed last
+   to first because a route can itself be an input of a later one. Layers keep their own
+   buffers once planned; this only refreshes views that already exist. */
+void link_route_outputs(network *net)
+{
+    int i, j;
+#ifdef GPU
+    if(gpu_index >= 0) return;
+#endif
+    for(i = net->n - 1; i >= 0; --i){
+        layer r = net->layers[i];
+        if(r.type != ROUTE) continue;
+        int offset = 0;
+        for(j = 0; j < r.n; ++j){
+            int index = r.input_layers[j];
+            layer *l = net->layers + index;
+            if(route_output_owner(net, index) == i && (l->output_view || !net->narenas)){
+                if(!l->output_view) free(l->output);
+                l->output = r.output + offset;
+                l->output_view = 1;
+            }
+            offset += r.input_sizes[j];
+        }
+    }
+    for(i = 1; i < net->n; ++i){
+        if(net->layers[i].type == DROPOUT) net->layers[i].output = net->layers[i-1].output;
+    }
+    net->output = get_network_output_layer(*net).output;
+}
+
+/* Give every view its own buffer again, ahead of a resize. */
+void unlink_route_outputs(network *net)
+{
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer *l = net->layers + i;
+        if(!l->output_view) continue;
+        l->output = calloc(l->outputs*l->batch, sizeof(float));
+        l->output_view = 0;
+    }
+    for(i = 1; i < net->n; ++i){
+        if(net->layers[i].type == DROPOUT) net->layers[i].output = net->layers[i-1].output;
+    }
+    net->output = get_network_output_layer(*net).output;
+}
+
 void forward_route_layer(const route_layer l, network net)
 {
     int i, j;
@@ -78,6 +163,10 @@ void forward_route_layer(const route_layer l, network net)
         int index = l.input_layers[i];
         float *input = net.layers[index].output;
         int input_size = l.input_sizes[i];
+        if(input == l.output + offset){
+            offset += input_size;
+            continue;
+        }
         for(j = 0; j < l.batch; ++j){
             copy_cpu(input_size, input + j*input_size, 1, l.output + offset + j*l.outputs, 1);
         }
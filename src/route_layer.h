@@ -5,10 +5,13 @@
 
 typedef layer route_layer;
 
-route_layer make_route_layer(int batch, int n, int *input_layers, int *input_size);
+route_layer make_route_layer(int batch, int n, int *input_layers, int *input_size, int train);
 void forward_route_layer(const route_layer l, network net);
 void backward_route_layer(const route_layer l, network net);
 void resize_route_layer(route_layer *l, network *net);
+int route_output_owner(network *net, int index);
+void link_route_outputs(network *net);
+void unlink_route_outputs(network *net);
 
 #ifdef GPU
 void forward_route_layer_gpu(const route_layer l, network net);
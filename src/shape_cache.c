@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shape_cache.h"
+#include "network.h"
+#include "convolutional_layer.h"
+#include "cuda.h"
+
+static float *fresh(float *p)
+{
+    return p ? calloc(1, sizeof(float)) : 0;
+}
+
+#ifdef GPU
+static float *fresh_gpu(float *p)
+{
+    return p ? cuda_make_array(0, 1) : 0;
+}
+#endif
+
+/* Give the active layers their own placeholder buffers so the next resize reallocates
+   those instead of the buffers now owned by the cache. */
+static void detach_layer(layer *l)
+{
+    if(l->type == DROPOUT){
+        l->output = l->delta = 0;
+    } else {
+        l->output = l->output_view ? 0 : fresh(l->output);
+        l->delta = fresh(l->delta);
+    }
+    l->x = fresh(l->x);
+    l->x_norm = fresh(l->x_norm);
+    l->squared = fresh(l->squared);
+    l->norms = fresh(l->norms);
+    l->rand = fresh(l->rand);
+    l->binary_input = fresh(l->binary_input);
+    l->indexes = l->indexes ? calloc(1, sizeof(int)) : 0;
+    if(l->input_sizes){
+        int *sizes = calloc(l->n, sizeof(int));
+        memcpy(sizes, l->input_sizes, l->n*sizeof(int));
+        l->input_sizes = sizes;
+    }
+#ifdef GPU
+    if(l->type == DROPOUT){
+        l->output_gpu = l->delta_gpu = 0;
+    } else {
+        l->output_gpu = fresh_gpu(l->output_gpu);
+        l->delta_gpu = fresh_gpu(l->delta_gpu);
+    }
+    l->x_gpu = fresh_gpu(l->x_gpu);
+    l->x_norm_gpu = fresh_gpu(l->x_norm_gpu);
+    l->squared_gpu = fresh_gpu(l->squared_gpu);
+    l->norms_gpu = fresh_gpu(l->norms_gpu);
+    l->rand_gpu = fresh_gpu(l->rand_gpu);
+    l->binary_input_gpu = fresh_gpu(l->binary_input_gpu);
+    l->indexes_gpu = l->indexes_gpu ? cuda_make_int_array(1) : 0;
+#endif
+}
+
+static int in_arenas(network_shape *s, float *p)
+{
+    int i;
+    for(i = 0; i < s->narenas; ++i) if(p == s->arenas[i]) return 1;
+    return 0;
+}
+
+static void free_shape(network_shape *s, int n)
+{
+    int i;
+    for(i = 0; i < n; ++i){
+        layer l = s->layers[i];
+        if(l.type != DROPOUT){
+            if(!in_arenas(s, l.output) && !l.output_view) free(l.output);
+            free(l.delta);
+        }
+        free(l.x);
+        free(l.x_norm);
+        free(l.squared);
+        free(l.norms);
+        free(l.rand);
+        free(l.binary_input);
+        free(l.indexes);
+        free(l.input_sizes);
+#ifdef GPU
+        if(l.type != DROPOUT){
+            if(l.output_gpu) cuda_free(l.output_gpu);
+            if(l.delta_gpu) cuda_free(l.delta_gpu);
+        }
+        if(l.x_gpu) cuda_free(l.x_gpu);
+        if(l.x_norm_gpu) cuda_free(l.x_norm_gpu);
+        if(l.squared_gpu) cuda_free(l.squared_gpu);
+        if(l.norms_gpu) cuda_free(l.norms_gpu);
+        if(l.rand_gpu) cuda_free(l.rand_gpu);
+        if(l.binary_input_gpu) cuda_free(l.binary_input_gpu);
+        if(l.indexes_gpu) cuda_free((float *)l.indexes_gpu);
+#endif
+    }
+    for(i = 0; i < s->narenas; ++i) free(s->arenas[i]);
+    free(s->arenas);
+    free(s->input);
+    free(s->truth);
+#ifdef GPU
+    if(s->input_gpu) cuda_free(s->input_gpu);
+    if(s->truth_gpu) cuda_free(s->truth_gpu);
+    if(gpu_index >= 0){
+        if(s->workspace) cuda_free(s->workspace);
+    } else {
+        free(s->workspace);
+    }
+#else
+    free(s->workspace);
+#endif
+    free(s->layers);
+    memset(s, 0, sizeof(network_shape));
+}
+
+void enable_shape_cache(network *net, int size)
+{
+    int i;
+    for(i = 0; i < net->n; ++i){
+        LAYER_TYPE t = net->layers[i].type;
+        if(t == RNN || t == GRU || t == CRNN){
+            fprintf(stderr, "Shape cache does not support recurrent layers\n");
+            return;
+        }
+    }
+    if(net->shapes || size < 1) return;
+    shape_cache *c = calloc(1, sizeof(shape_cache));
+    c->size = size;
+    c->current = -1;
+    c->shapes = calloc(size, sizeof(network_shape));
+    net->shapes = c;
+}
+
+void store_network_shape(network *net)
+{
+    shape_cache *c = net->shapes;
+    int i = c->current;
+    if(i < 0){
+        if(c->n < c->size){
+            i = c->n++;
+        } else {
+            int k;
+            i = 0;
+            for(k = 1; k < c->n; ++k) if(c->shapes[k].used < c->shapes[i].used) i = k;
+            free_shape(c->shapes + i, net->n);
+        }
+        c->shapes[i].layers = calloc(net->n, sizeof(layer));
+        c->current = i;
+    }
+    network_shape *s = c->shapes + i;
+    s->w = net->w;
+    s->h = net->h;
+    s->batch = net->batch;
+    s->used = ++c->clock;
+    memcpy(s->layers, net->layers, net->n*sizeof(layer));
+    s->input = net->input;
+    s->truth = net->truth;
+    s->workspace = net->workspace;
+    s->output = net->output;
+    s->inputs = net->inputs;
+    s->outputs = net->outputs;
+    s->truths = net->truths;
+    s->arenas = net->arenas;
+    s->narenas = net->narenas;
+#ifdef GPU
+    s->input_gpu = net->input_gpu;
+    s->truth_gpu = net->truth_gpu;
+#endif
+}
+
+static void restore_network_shape(network *net, network_shape *s)
+{
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer l = s->layers[i];
+        layer cur = net->layers[i];
+        l.weights = cur.weights;
+        l.biases = cur.biases;
+        l.scales = cur.scales;
+        l.rolling_mean = cur.rolling_mean;
+        l.rolling_variance = cur.rolling_variance;
+        l.quantized = cur.quantized;
+        l.qweights = cur.qweights;
+        l.qscales = cur.qscales;
+        l.bitpacked = cur.bitpacked;
+        l.bit_weights = cur.bit_weights;
+        l.bit_scales = cur.bit_scales;
+        l.half = cur.half;
+        l.half_weights = cur.half_weights;
+        l.winograd = cur.winograd;
+        l.winograd_weights = cur.winograd_weights;
+        net->layers[i] = l;
+#ifdef CUDNN
+        if(l.type == CONVOLUTIONAL) cudnn_convolutional_setup(net->layers + i);
+        if((l.type == DECONVOLUTIONAL || l.type == CONNECTED) && l.batch_normalize){
+            cudnnSetTensor4dDescriptor(l.dstTensorDesc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT, l.batch, l.out_c, l.out_h, l.out_w);
+        }
+#endif
+    }
+    net->w = s->w;
+    net->h = s->h;
+    net->batch = s->batch;
+    net->input = s->input;
+    net->truth = s->truth;
+    net->workspace = s->workspace;
+    net->output = s->output;
+    net->inputs = s->inputs;
+    net->outputs = s->outputs;
+    net->truths = s->truths;
+    net->arenas = s->arenas;
+    net->narenas = s->narenas;
+#ifdef GPU
+    net->input_gpu = s->input_gpu;
+    net->truth_gpu = s->truth_gpu;
+#endif
+}
+
+int switch_network_shape(network *net, int w, int h, int batch)
+{
+    int i;
+    shape_cache *c = net->shapes;
+    store_network_shape(net);
+    for(i = 0; i < c->n; ++i){
+        network_shape *s = c->shapes + i;
+        if(s->w == w && s->h == h && s->batch == batch){
+            if(i != c->current) restore_network_shape(net, s);
+            s->used = ++c->clock;
+            c->current = i;
+            return 1;
+        }
+    }
+    for(i = 0; i < net->n; ++i) detach_layer(net->layers + i);
+    net->input = net->truth = net->workspace = 0;
+    net->arenas = 0;
+    net->narenas = 0;
+#ifdef GPU
+    net->input_gpu = net->truth_gpu = 0;
+#endif
+    c->current = -1;
+    return 0;
+}
+
+void free_shape_cache(network *net)
+{
+    int i;
+    shape_cache *c = net->shapes;
+    if(!c) return;
+    for(i = 0; i < c->n; ++i){
+        if(i != c->current) free_shape(c->shapes + i, net->n);
+        else free(c->shapes[i].layers);
+    }
+    free(c->shapes);
+    free(c);
+    net->shapes = 0;
+}
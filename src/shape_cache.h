@@ -0,0 +1,36 @@
+#ifndef SHAPE_CACHE_H
+#define SHAPE_CACHE_H
+
+#include "layer.h"
+
+typedef struct{
+    int w, h, batch;
+    int used;
+    layer *layers;
+    float *input;
+    float *truth;
+    float *workspace;
+    float *output;
+    int inputs, outputs, truths;
+    float **arenas;
+    int narenas;
+#ifdef GPU
+    float *input_gpu;
+    float *truth_gpu;
+#endif
+} network_shape;
+
+typedef struct shape_cache{
+    int size;
+    int n;
+    int current;
+    int clock;
+    network_shape *shapes;
+} shape_cache;
+
+void enable_shape_cache(network *net, int size);
+int switch_network_shape(network *net, int w, int h, int batch);
+void store_network_shape(network *net);
+void free_shape_cache(network *net);
+
+#endif
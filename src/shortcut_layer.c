@@ -4,7 +4,7 @@
 #include <stdio.h>
 #include <assert.h>
 
-layer make_shortcut_layer(int batch, int index, int w, int h, int c, int w2, int h2, int c2)
+layer make_shortcut_layer(int batch, int index, int w, int h, int c, int w2, int h2, int c2, int train)
 {
     fprintf(stderr,"Shortcut Layer: %d\n", index);
     layer l = {0};
@@ -21,7 +21,7 @@ layer make_shortcut_layer(int batch, int index, int w, int h, int c, int w2, int
 
     l.index = index;
 
-    l.delta =  calloc(l.outputs*batch, sizeof(float));
+    if(train) l.delta = calloc(l.outputs*batch, sizeof(float));
     l.output = calloc(l.outputs*batch, sizeof(float));;
 
     l.forward = forward_shortcut_layer;
@@ -30,14 +30,62 @@ layer make_shortcut_layer(int batch, int index, int w, int h, int c, int w2, int
     l.forward_gpu = forward_shortcut_layer_gpu;
     l.backward_gpu = backward_shortcut_layer_gpu;
 
-    l.delta_gpu =  cuda_make_array(l.delta, l.outputs*batch);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, l.outputs*batch);
     l.output_gpu = cuda_make_array(l.output, l.outputs*batch);
     #endif
     return l;
 }
 
+void resize_shortcut_layer(layer *l, network *net, int w, int h)
+{
+    layer from = net->layers[l->index];
+    l->w = from.out_w;
+    l->h = from.out_h;
+    l->out_w = w;
+    l->out_h = h;
+    l->outputs = w*h*l->out_c;
+    l->inputs = l->outputs;
+
+    l->output = realloc(l->output, l->outputs*l->batch*sizeof(float));
+    if(l->delta) l->delta = realloc(l->delta, l->outputs*l->batch*sizeof(float));
+
+#ifdef GPU
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    l->output_gpu  = cuda_make_array(l->output, l->outputs*l->batch);
+    if(l->delta) l->delta_gpu   = cuda_make_array(l->delta,  l->outputs*l->batch);
+#endif
+}
+
+/* out = activate(x + add) in one pass for residual blocks whose shapes match. */
+static int shortcut_activate_cpu(int n, float *x, float *add, ACTIVATION a, float *out)
+{
+    int i;
+    switch(a){
+        case LINEAR:
+            for(i = 0; i < n; ++i) out[i] = x[i] + add[i];
+            return 1;
+        case LEAKY:
+            for(i = 0; i < n; ++i){
+                float v = x[i] + add[i];
+                out[i] = (v > 0) ? v : .1*v;
+            }
+            return 1;
+        case RELU:
+            for(i = 0; i < n; ++i){
+                float v = x[i] + add[i];
+                out[i] = (v > 0) ? v : 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 void forward_shortcut_layer(const layer l, network net)
 {
+    if(l.w == l.out_w && l.h == l.out_h && l.c == l.out_c &&
+            shortcut_activate_cpu(l.outputs*l.batch, net.input, net.layers[l.index].output, l.activation, l.output)) return;
     copy_cpu(l.outputs*l.batch, net.input, 1, l.output, 1);
     shortcut_cpu(l.batch, l.w, l.h, l.c, net.layers[l.index].output, l.out_w, l.out_h, l.out_c, l.output);
     activate_array(l.output, l.outputs*l.batch, l.activation);
@@ -1,6 +1,7 @@
 #include "softmax_layer.h"
 #include "blas.h"
 #include "cuda.h"
+#include "utils.h"
 #include <float.h>
 #include <math.h>
 #include <stdlib.h>
@@ -32,6 +33,21 @@ softmax_layer make_softmax_layer(int batch, int inputs, int groups)
     return l;
 }
 
+void resize_softmax_layer(softmax_layer *l, int inputs)
+{
+    if(inputs%l->groups) error("Softmax inputs must divide into groups");
+    l->inputs = inputs;
+    l->outputs = inputs;
+    l->output = realloc(l->output, inputs*l->batch*sizeof(float));
+    l->delta = realloc(l->delta, inputs*l->batch*sizeof(float));
+    #ifdef GPU
+    cuda_free(l->output_gpu);
+    cuda_free(l->delta_gpu);
+    l->output_gpu = cuda_make_array(l->output, inputs*l->batch);
+    l->delta_gpu = cuda_make_array(l->delta, inputs*l->batch);
+    #endif
+}
+
 void forward_softmax_layer(const softmax_layer l, network net)
 {
     if(l.softmax_tree){
@@ -9,6 +9,7 @@ void softmax_array(float *input, int n, float temp, float *output);
 softmax_layer make_softmax_layer(int batch, int inputs, int groups);
 void forward_softmax_layer(const softmax_layer l, network net);
 void backward_softmax_layer(const softmax_layer l, network net);
+void resize_softmax_layer(softmax_layer *l, int inputs);
 
 #ifdef GPU
 void pull_softmax_layer_output(const softmax_layer l);
@@ -4,6 +4,8 @@
 #include "utils.h"
 #include "classifier.h"
 #include "option_list.h"
+#include "memory_planner.h"
+#include "tracker.h"
 #include "test_calling_from_python.h"
 
 #include <stdio.h>
@@ -13,6 +15,9 @@
 
 network current_network;
 int network_created = 0;
+int dynamic_input_pixels = 0;
+static int base_width, base_height;
+static tracker *python_tracker;
 
 /** Make necessary back transformations for the box from reduced image to its real size.
   * Also there are several checks for consistency
@@ -52,6 +57,7 @@ result_box transform_box(box b, box_transform_param config, int class, float pro
 
   res_b.class_num = class;
   res_b.conf = prob;
+  res_b.track_id = 0;
 
   return res_b;
 }
@@ -105,9 +111,10 @@ and calls the function wiche prepares them for python wrapper
   * @param height_old: height of the image before resize
   * @param width_resized: width of the image after resize
   * @param height_resized: height of the image after resize
+  * @param ids: track id of each box, or 0 when not tracking
   * @return necessary parameters for later transformations
 */
-result_box_arr result_detection(image im, int num, float thresh, box *boxes, float **probs, int classes, int width_old, int height_old, int width_resized, int height_resized)
+result_box_arr result_detection(image im, int num, float thresh, box *boxes, float **probs, int classes, int width_old, int height_old, int width_resized, int height_resized, int *ids)
 {
     // helper part for python - just counting the size of the array
     int i;
@@ -138,6 +145,7 @@ result_box_arr result_detection(image im, int num, float thresh, box *boxes, flo
                res.size--;
                continue;
             }
+            if (ids) cur_box.track_id = ids[i];
 
             res.pred_boxes[count] = cur_box;
 
@@ -159,11 +167,15 @@ result_box_arr result_detection(image im, int num, float thresh, box *boxes, flo
 */
 void initialize_network_test(char *cfgfile, char *weightfile)
 {
-    network net = parse_network_cfg(cfgfile);
+    network net = parse_network_cfg_custom(cfgfile, 0, 0);
     if(weightfile){
         load_weights(&net, weightfile);
     }
     set_batch_network(&net, 1);
+    plan_network_memory(&net);
+    enable_shape_cache(&net, 4);
+    base_width = net.w;
+    base_height = net.h;
     network_created = 1;
     current_network = net;
 }
@@ -180,15 +192,42 @@ void initialize_network_test_param(char *cfgfile, char *weightfile, cfg_param gr
     if (network_created) {
         free_network(current_network);
     }
-    current_network = parse_network_cfg_param(cfgfile, grid_parameters);
+    current_network = parse_network_cfg_custom(cfgfile, &grid_parameters, 0);
     if(weightfile){
         load_weights(&current_network, weightfile);
     }
     set_batch_network(&current_network, 1);
+    plan_network_memory(&current_network);
+    enable_shape_cache(&current_network, 4);
+    base_width = current_network.w;
+    base_height = current_network.h;
     network_created = 1;
 }
 
 
+/** switches hot_predict between the fixed cfg input and a per-image input size
+
+  * @param max_pixels: pixel budget for the network input; 0 turns dynamic input off,
+  *                    a negative value uses the area of the cfg input
+  * @return: nothing, but hot_predict resizes the network to each image's aspect ratio
+*/
+void set_dynamic_input(int max_pixels)
+{
+    dynamic_input_pixels = max_pixels < 0 ? base_width*base_height : max_pixels;
+}
+
+/** turns tracking of boxes across consecutive hot_predict calls on or off,
+  * for feeding the frames of one video in order
+
+  * @param enabled: 1 starts a new tracker (dropping any previous tracks), 0 stops tracking
+  * @return: nothing, but hot_predict smooths the boxes over frames and fills result_box.track_id
+*/
+void set_tracking(int enabled)
+{
+    free_tracker(python_tracker);
+    python_tracker = enabled ? make_tracker(.3, 3) : 0;
+}
+
 /** HAVE NEVER BEEN IN USE - NEEDS CAREFUL TESTING
   * calculates the map of probabilities to build an assemly of several neural networks
   * more or less detailed plan you can find in google doc
@@ -279,6 +318,14 @@ result_box_arr hot_predict(char *filename, image part_im, float thresh, float hi
     int old_width = im.w;
     int old_height = im.h;
     int width_resized, height_resized;
+    int w = base_width, h = base_height;
+    if (dynamic_input_pixels) {
+      fit_network_input(net, im.w, im.h, dynamic_input_pixels, &w, &h);
+    }
+    if (w != net.w || h != net.h) {
+      resize_network(&current_network, w, h);
+      net = current_network;
+    }
     image sized = letterbox_image_with_info(im, net.w, net.h, &width_resized, &height_resized);
     layer l = net.layers[net.n-1];
 
@@ -286,18 +333,31 @@ result_box_arr hot_predict(char *filename, image part_im, float thresh, float hi
     float **probs = calloc(l.w*l.h*l.n, sizeof(float *));
     for(j = 0; j < l.w*l.h*l.n; ++j) probs[j] = calloc(l.classes + 1, sizeof(float *));
 
+    int *ids = python_tracker ? calloc(l.w*l.h*l.n, sizeof(int)) : 0;
+
     float *X = sized.data;
     network_predict(net, X);
-    get_region_boxes(l, 1, 1, net.w, net.h, thresh, probs, boxes, 0, 0, hier_thresh, 1);
-    if (l.softmax_tree && nms) do_nms_obj(boxes, probs, l.w*l.h*l.n, l.classes, nms);
-    else if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, l.classes, nms);
-
-    result_box_arr res = result_detection(sized, l.w*l.h*l.n, thresh, boxes, probs, l.classes, old_width, old_height, width_resized, height_resized);
+    result_box_arr res;
+    if (dynamic_input_pixels) {
+      // boxes come back relative to the original image, so no letterbox transform is left
+      get_region_boxes(l, old_width, old_height, net.w, net.h, thresh, probs, boxes, 0, 0, hier_thresh, 1);
+      if (l.softmax_tree && nms) do_nms_obj(boxes, probs, l.w*l.h*l.n, l.classes, nms);
+      else if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, l.classes, nms);
+      if (python_tracker) track_detections(python_tracker, boxes, probs, l.w*l.h*l.n, l.classes, thresh, ids);
+      res = result_detection(im, l.w*l.h*l.n, thresh, boxes, probs, l.classes, old_width, old_height, old_width, old_height, ids);
+    } else {
+      get_region_boxes(l, 1, 1, net.w, net.h, thresh, probs, boxes, 0, 0, hier_thresh, 1);
+      if (l.softmax_tree && nms) do_nms_obj(boxes, probs, l.w*l.h*l.n, l.classes, nms);
+      else if (nms) do_nms_sort(boxes, probs, l.w*l.h*l.n, l.classes, nms);
+      if (python_tracker) track_detections(python_tracker, boxes, probs, l.w*l.h*l.n, l.classes, thresh, ids);
+      res = result_detection(sized, l.w*l.h*l.n, thresh, boxes, probs, l.classes, old_width, old_height, width_resized, height_resized, ids);
+    }
     if (from_image != 1) {
       free_image(im);
     }
     free_image(sized);
     free(boxes);
+    free(ids);
     free_ptrs((void **)probs, l.w*l.h*l.n);
 
     return res;
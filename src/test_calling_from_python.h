@@ -8,6 +8,7 @@ typedef struct{
     int left, top, right, bottom;
     int class_num;
     float conf;
+    int track_id;
 } result_box;
 
 typedef struct{
@@ -30,6 +31,8 @@ typedef struct{
 // void print_detections_to_file(image im, int num, float thresh, box *boxes, float **probs, int classes, int width_old, int height_old);
 void initialize_network_test(char *cfgfile, char *weightfile);
 void initialize_network_test_param(char *cfgfile, char *weightfile, cfg_param grid_parameters);
+void set_dynamic_input(int max_pixels);
+void set_tracking(int enabled);
 result_box_arr hot_predict(char *filename, image part_im, float thresh, float hier_thresh, int from_image);
 float * calculate_map_of_probabilities(image im, box *boxes, float **probs, int num_anchors,
               int classes, int width_old, int height_old, int width_resized, int height_resized);
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tracker.h"
+#include "utils.h"
+
+/* Alpha-beta gains: half of each residual goes to the box, beta = alpha^2/(2 - alpha) to its velocity. */
+#define TRACK_ALPHA .5f
+#define TRACK_BETA (TRACK_ALPHA*TRACK_ALPHA/(2 - TRACK_ALPHA))
+
+typedef struct {
+    int track;
+    int det;
+    float iou;
+} track_match;
+
+typedef struct {
+    box b;
+    int class;
+    float prob;
+    int slot;
+} track_det;
+
+tracker *make_tracker(float iou_thresh, int max_misses)
+{
+    tracker *t = calloc(1, sizeof(tracker));
+    t->iou_thresh = iou_thresh;
+    t->max_misses = max_misses;
+    return t;
+}
+
+void free_tracker(tracker *t)
+{
+    if(!t) return;
+    free(t->tracks);
+    free(t);
+}
+
+static int match_comparator(const void *pa, const void *pb)
+{
+    float a = ((track_match *)pa)->iou;
+    float b = ((track_match *)pb)->iou;
+    return (a < b) - (a > b);
+}
+
+static void filter_step(float *x, float *v, float measured)
+{
+    float r = measured - *x;
+    *x += TRACK_ALPHA*r;
+    *v += TRACK_BETA*r;
+}
+
+static void update_track(track *k, track_det d)
+{
+    filter_step(&k->b.x, &k->v.x, d.b.x);
+    filter_step(&k->b.y, &k->v.y, d.b.y);
+    filter_step(&k->b.w, &k->v.w, d.b.w);
+    filter_step(&k->b.h, &k->v.h, d.b.h);
+    k->prob += TRACK_ALPHA*(d.prob - k->prob);
+    ++k->hits;
+    k->misses = 0;
+}
+
+static void predict_track(track *k)
+{
+    k->b.x += k->v.x;
+    k->b.y += k->v.y;
+    k->b.w += k->v.w;
+    k->b.h += k->v.h;
+    if(k->b.w < 1e-6) k->b.w = 1e-6;
+    if(k->b.h < 1e-6) k->b.h = 1e-6;
+}
+
+/* Associates the detections that survived nms with the tracks by class and IoU, greedily from the
+   best overlap, and replaces them in boxes/probs with the filtered track boxes. Tracks seen at least
+   twice coast on their velocity for up to max_misses frames. Returns the number of boxes written;
+   ids, if given, receives the track id of each. State is a few floats per track, where averaging
+   keeps avg_frames copies of the whole network output. */
+int track_detections(tracker *t, box *boxes, float **probs, int total, int classes, float thresh, int *ids)
+{
+    int i, j;
+    int ndets = 0;
+    track_det *dets = calloc(total, sizeof(track_det));
+    for(i = 0; i < total; ++i){
+        int class = max_index(probs[i], classes);
+        if(probs[i][class] <= thresh) continue;
+        dets[ndets].b = boxes[i];
+        dets[ndets].class = class;
+        dets[ndets].prob = probs[i][class];
+        dets[ndets].slot = i;
+        ++ndets;
+    }
+
+    for(i = 0; i < t->n; ++i) predict_track(t->tracks + i);
+
+    int nmatches = 0;
+    track_match *matches = calloc(t->n*ndets + 1, sizeof(track_match));
+    for(i = 0; i < t->n; ++i){
+        for(j = 0; j < ndets; ++j){
+            if(t->tracks[i].class != dets[j].class) continue;
+            float iou = box_iou(t->tracks[i].b, dets[j].b);
+            if(iou < t->iou_thresh) continue;
+            track_match m = {i, j, iou};
+            matches[nmatches++] = m;
+        }
+    }
+    qsort(matches, nmatches, sizeof(track_match), match_comparator);
+
+    int *det_track = calloc(ndets + 1, sizeof(int));
+    int *matched = calloc(t->n + 1, sizeof(int));
+    for(j = 0; j < ndets; ++j) det_track[j] = -1;
+    for(i = 0; i < nmatches; ++i){
+        track_match m = matches[i];
+        if(matched[m.track] || det_track[m.det] >= 0) continue;
+        matched[m.track] = 1;
+        det_track[m.det] = m.track;
+        update_track(t->tracks + m.track, dets[m.det]);
+    }
+
+    int n = 0;
+    for(i = 0; i < t->n; ++i){
+        track k = t->tracks[i];
+        if(!matched[i]) ++k.misses;
+        if(k.misses > t->max_misses) continue;
+        t->tracks[n++] = k;
+    }
+    t->n = n;
+    if(t->n + ndets > t->size){
+        t->size = t->n + ndets;
+        t->tracks = realloc(t->tracks, t->size*sizeof(track));
+    }
+    for(j = 0; j < ndets; ++j){
+        if(det_track[j] >= 0) continue;
+        track k = {0};
+        k.b = dets[j].b;
+        k.class = dets[j].class;
+        k.prob = dets[j].prob;
+        k.id = ++t->next_id;
+        k.hits = 1;
+        t->tracks[t->n++] = k;
+    }
+
+    for(j = 0; j < ndets; ++j) memset(probs[dets[j].slot], 0, classes*sizeof(float));
+    int count = 0;
+    for(i = 0; i < t->n && count < total; ++i){
+        track k = t->tracks[i];
+        if(k.misses && k.hits < 2) continue;
+        memset(probs[count], 0, classes*sizeof(float));
+        boxes[count] = k.b;
+        probs[count][k.class] = k.prob;
+        if(ids) ids[count] = k.id;
+        ++count;
+    }
+
+    free(dets);
+    free(matches);
+    free(det_track);
+    free(matched);
+    return count;
+}
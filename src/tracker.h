@@ -0,0 +1,29 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "box.h"
+
+typedef struct {
+    box b;
+    box v;
+    int class;
+    float prob;
+    int id;
+    int hits;
+    int misses;
+} track;
+
+typedef struct {
+    track *tracks;
+    int n;
+    int size;
+    int next_id;
+    float iou_thresh;
+    int max_misses;
+} tracker;
+
+tracker *make_tracker(float iou_thresh, int max_misses);
+void free_tracker(tracker *t);
+int track_detections(tracker *t, box *boxes, float **probs, int total, int classes, float thresh, int *ids);
+
+#endif
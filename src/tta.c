@@ -0,0 +1,210 @@
+#include "tta.h"
+#include "region_layer.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Transforms are a comma separated list of letterbox scales, each
+   optionally prefixed with 'f' to also mirror the image: "1,f1,.75" */
+tta_config parse_tta(char *s)
+{
+    tta_config c = {0};
+    c.iou = .55;
+    if(!s) s = "1";
+    int len = strlen(s);
+    int i;
+    c.n = 1;
+    for(i = 0; i < len; ++i){
+        if (s[i] == ',') ++c.n;
+    }
+    c.transforms = calloc(c.n, sizeof(tta_transform));
+    for(i = 0; i < c.n; ++i){
+        if(*s == 'f'){
+            c.transforms[i].flip = 1;
+            ++s;
+        }
+        c.transforms[i].scale = atof(s);
+        if(c.transforms[i].scale <= 0) c.transforms[i].scale = 1;
+        char *next = strchr(s, ',');
+        if(next) s = next+1;
+    }
+    return c;
+}
+
+void free_tta(tta_config c)
+{
+    free(c.transforms);
+}
+
+int tta_boxes(tta_config c, network net)
+{
+    layer l = net.layers[net.n-1];
+    return (c.n ? c.n : 1)*l.w*l.h*l.n;
+}
+
+void set_batch_tta(network *net, tta_config c)
+{
+    set_batch_network(net, c.n);
+}
+
+typedef struct{
+    int index;
+    float prob;
+} tta_candidate;
+
+static int tta_comparator(const void *pa, const void *pb)
+{
+    float diff = ((tta_candidate *)pa)->prob - ((tta_candidate *)pb)->prob;
+    if(diff < 0) return 1;
+    else if(diff > 0) return -1;
+    return 0;
+}
+
+/* Weighted box fusion: candidates are visited by confidence and each one
+   joins the first cluster of the same top class whose running fused box
+   overlaps it by more than iou, otherwise it starts a new one. Coordinates
+   are confidence weighted; class probabilities are averaged and scaled down
+   when fewer than all views agree. Returns the number of fused boxes. */
+int fuse_boxes(box *cand, float **cand_probs, int n, int classes, int views, float iou, box *boxes, float **probs)
+{
+    int i, j, k;
+    int clusters = 0;
+    tta_candidate *order = calloc(n, sizeof(tta_candidate));
+    int *class = calloc(n, sizeof(int));
+    int *cluster_class = calloc(n, sizeof(int));
+    float *weight = calloc(n, sizeof(float));
+    int *count = calloc(n, sizeof(int));
+    int m = 0;
+    for(i = 0; i < n; ++i){
+        int top = max_index(cand_probs[i], classes);
+        if(cand_probs[i][top] > 0){
+            order[m].index = i;
+            order[m].prob = cand_probs[i][top];
+            class[i] = top;
+            ++m;
+        }
+    }
+    qsort(order, m, sizeof(tta_candidate), tta_comparator);
+    for(i = 0; i < m; ++i){
+        int c = order[i].index;
+        box b = cand[c];
+        float p = order[i].prob;
+        for(j = 0; j < clusters; ++j){
+            if(cluster_class[j] != class[c]) continue;
+            box f = {boxes[j].x/weight[j], boxes[j].y/weight[j], boxes[j].w/weight[j], boxes[j].h/weight[j]};
+            if(box_iou(f, b) > iou) break;
+        }
+        if(j == clusters){
+            box zero = {0};
+            boxes[j] = zero;
+            memset(probs[j], 0, (classes+1)*sizeof(float));
+            weight[j] = 0;
+            count[j] = 0;
+            cluster_class[j] = class[c];
+            ++clusters;
+        }
+        boxes[j].x += p*b.x;
+        boxes[j].y += p*b.y;
+        boxes[j].w += p*b.w;
+        boxes[j].h += p*b.h;
+        weight[j] += p;
+        ++count[j];
+        for(k = 0; k < classes; ++k) probs[j][k] += cand_probs[c][k];
+    }
+    for(j = 0; j < clusters; ++j){
+        int agree = (count[j] < views) ? count[j] : views;
+        float scale = (float)agree/views/count[j];
+        boxes[j].x /= weight[j];
+        boxes[j].y /= weight[j];
+        boxes[j].w /= weight[j];
+        boxes[j].h /= weight[j];
+        probs[j][classes] = 0;
+        for(k = 0; k < classes; ++k){
+            probs[j][k] *= scale;
+            if(probs[j][k] > probs[j][classes]) probs[j][classes] = probs[j][k];
+        }
+    }
+    free(order);
+    free(class);
+    free(cluster_class);
+    free(weight);
+    free(count);
+    return clusters;
+}
+
+/* Runs every transform of im through the network as one batch (the network
+   batch must already be set to c.n), maps the boxes back onto im and fuses
+   them into boxes/probs, which must hold tta_boxes(c, net) entries.
+   Returns the number of fused boxes. */
+int tta_predict(tta_config c, network net, image im, float thresh, float nms, box *boxes, float **probs, int *map, float hier_thresh, int relative)
+{
+    int i, t;
+    layer l = net.layers[net.n-1];
+    int total = l.w*l.h*l.n;
+    int fit_w = im.w;
+    int fit_h = im.h;
+    if (((float)net.w/im.w) < ((float)net.h/im.h)) {
+        fit_w = net.w;
+        fit_h = (im.h * net.w)/im.w;
+    } else {
+        fit_h = net.h;
+        fit_w = (im.w * net.h)/im.h;
+    }
+
+    image input = make_image(net.w, net.h, net.c*c.n);
+    fill_image(input, .5);
+    int *dx = calloc(c.n, sizeof(int));
+    int *dy = calloc(c.n, sizeof(int));
+    int *sw = calloc(c.n, sizeof(int));
+    int *sh = calloc(c.n, sizeof(int));
+    for(t = 0; t < c.n; ++t){
+        sw[t] = fit_w*c.transforms[t].scale;
+        sh[t] = fit_h*c.transforms[t].scale;
+        if(sw[t] < 1) sw[t] = 1;
+        if(sh[t] < 1) sh[t] = 1;
+        dx[t] = (net.w - sw[t])/2;
+        dy[t] = (net.h - sh[t])/2;
+        image view = float_to_image(net.w, net.h, net.c, input.data + t*net.w*net.h*net.c);
+        image resized = resize_image(im, sw[t], sh[t]);
+        if(c.transforms[t].flip) flip_image(resized);
+        embed_image(resized, view, dx[t], dy[t]);
+        free_image(resized);
+    }
+    network_predict(net, input.data);
+
+    box *cand = calloc(c.n*total, sizeof(box));
+    float **cand_probs = calloc(c.n*total, sizeof(float *));
+    for(i = 0; i < c.n*total; ++i) cand_probs[i] = calloc(l.classes + 1, sizeof(float));
+    for(t = 0; t < c.n; ++t){
+        layer view = l;
+        view.output = l.output + t*l.outputs;
+        box *b = cand + t*total;
+        float **p = cand_probs + t*total;
+        get_region_boxes(view, net.w, net.h, net.w, net.h, thresh, p, b, 0, map, hier_thresh, 1);
+        if (nms) do_nms_sort(b, p, total, l.classes, nms);
+        for(i = 0; i < total; ++i){
+            b[i].x = (b[i].x*net.w - dx[t])/sw[t];
+            b[i].y = (b[i].y*net.h - dy[t])/sh[t];
+            b[i].w = b[i].w*net.w/sw[t];
+            b[i].h = b[i].h*net.h/sh[t];
+            if(c.transforms[t].flip) b[i].x = 1 - b[i].x;
+            if(!relative){
+                b[i].x *= im.w;
+                b[i].w *= im.w;
+                b[i].y *= im.h;
+                b[i].h *= im.h;
+            }
+        }
+    }
+    int count = fuse_boxes(cand, cand_probs, c.n*total, l.classes, c.n, c.iou, boxes, probs);
+
+    free_ptrs((void **)cand_probs, c.n*total);
+    free(cand);
+    free(dx);
+    free(dy);
+    free(sw);
+    free(sh);
+    free_image(input);
+    return count;
+}
@@ -0,0 +1,26 @@
+#ifndef TTA_H
+#define TTA_H
+
+#include "network.h"
+#include "image.h"
+#include "box.h"
+
+typedef struct{
+    int flip;
+    float scale;
+} tta_transform;
+
+typedef struct{
+    int n;
+    tta_transform *transforms;
+    float iou;
+} tta_config;
+
+tta_config parse_tta(char *s);
+void free_tta(tta_config c);
+int tta_boxes(tta_config c, network net);
+void set_batch_tta(network *net, tta_config c);
+int tta_predict(tta_config c, network net, image im, float thresh, float nms, box *boxes, float **probs, int *map, float hier_thresh, int relative);
+int fuse_boxes(box *cand, float **cand_probs, int n, int classes, int views, float iou, box *boxes, float **probs);
+
+#endif
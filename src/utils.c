@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <float.h>
 #include <limits.h>
+#include <sys/time.h>
 
 #include "utils.h"
 
@@ -189,6 +190,15 @@ void find_replace(char *str, char *orig, char *rep, char *output)
     sprintf(output, "%s%s%s", buffer, rep, p+strlen(orig));
 }
 
+double get_wall_time()
+{
+    struct timeval time;
+    if (gettimeofday(&time,NULL)){
+        return 0;
+    }
+    return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
 float sec(clock_t clocks)
 {
     return (float)clocks/CLOCKS_PER_SEC;
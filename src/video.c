@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "video.h"
+#include "utils.h"
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+
+/* Chroma layouts of a stream; RAW_RGB is packed rgb24 with no header. */
+enum {RAW_RGB, Y4M_MONO, Y4M_420, Y4M_444};
+
+static FILE *open_ffmpeg(char *filename)
+{
+    size_t i, k = 0;
+    char *cmd = calloc(strlen(filename)*4 + 128, sizeof(char));
+    k += sprintf(cmd, "ffmpeg -loglevel error -nostdin -i '");
+    for(i = 0; filename[i]; ++i){
+        if(filename[i] == '\'') k += sprintf(cmd + k, "'\\''");
+        else cmd[k++] = filename[i];
+    }
+    sprintf(cmd + k, "' -f yuv4mpegpipe -pix_fmt yuv420p -");
+    FILE *file = popen(cmd, "r");
+    free(cmd);
+    return file;
+}
+
+/* ffmpeg always writes a Y4M header, so a pipe without one means the child failed. */
+static void ffmpeg_error(FILE *file, char *filename)
+{
+    int status = pclose(file);
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 127){
+        error("ffmpeg not found, install it or pass a .y4m or .rgb stream");
+    }
+    fprintf(stderr, "ffmpeg couldn't decode %s\n", filename);
+    error("ffmpeg failed");
+}
+
+static void parse_y4m_header(video_stream *v)
+{
+    char *line = fgetl(v->file);
+    if(!line) error("Truncated Y4M header");
+    char *tok;
+    v->chroma = Y4M_420;
+    for(tok = strtok(line, " "); tok; tok = strtok(0, " ")){
+        if(tok[0] == 'W') v->w = atoi(tok + 1);
+        else if(tok[0] == 'H') v->h = atoi(tok + 1);
+        else if(tok[0] == 'C'){
+            if(0==strncmp(tok + 1, "420", 3)) v->chroma = Y4M_420;
+            else if(0==strcmp(tok + 1, "444")) v->chroma = Y4M_444;
+            else if(0==strcmp(tok + 1, "mono")) v->chroma = Y4M_MONO;
+            else {
+                fprintf(stderr, "Y4M colorspace %s\n", tok + 1);
+                error("Unsupported Y4M colorspace, convert to 420, 444 or mono");
+            }
+        }
+    }
+    free(line);
+    if(v->w <= 0 || v->h <= 0) error("Y4M header has no frame size");
+    size_t luma = (size_t)v->w*v->h;
+    size_t cw = (v->w + 1)/2, ch = (v->h + 1)/2;
+    if(v->chroma == Y4M_MONO) v->frame_bytes = luma;
+    else if(v->chroma == Y4M_444) v->frame_bytes = 3*luma;
+    else v->frame_bytes = luma + 2*cw*ch;
+}
+
+/* "-" is stdin, .y4m and .rgb files are read directly and anything else is decoded by an ffmpeg
+   child into Y4M. Streams without a Y4M header are packed rgb24 frames of w x h. */
+video_stream *open_video_stream(char *filename, int w, int h)
+{
+    video_stream *v = calloc(1, sizeof(video_stream));
+    if(0==strcmp(filename, "-")){
+        v->file = stdin;
+    } else if(strstr(filename, ".y4m") || strstr(filename, ".rgb")){
+        v->file = fopen(filename, "rb");
+    } else {
+        v->file = open_ffmpeg(filename);
+        v->pipe = 1;
+    }
+    if(!v->file) file_error(filename);
+
+    size_t magic = strlen(Y4M_MAGIC);
+    size_t max = magic;
+    if(w > 0 && h > 0 && (size_t)w*h*3 > max) max = (size_t)w*h*3;
+    v->buf = calloc(max, sizeof(unsigned char));
+    size_t got = fread(v->buf, 1, magic, v->file);
+    if(got == magic && 0==memcmp(v->buf, Y4M_MAGIC, magic)){
+        parse_y4m_header(v);
+        free(v->buf);
+        v->buf = calloc(v->frame_bytes, sizeof(unsigned char));
+    } else {
+        if(v->pipe) ffmpeg_error(v->file, filename);
+        if(w <= 0 || h <= 0) error("Video stream is not Y4M, pass -w and -h for raw rgb24 frames");
+        v->chroma = RAW_RGB;
+        v->w = w;
+        v->h = h;
+        v->frame_bytes = (size_t)w*h*3;
+        v->pending = got;
+    }
+    fprintf(stderr, "Video %dx%d %s\n", v->w, v->h, v->chroma == RAW_RGB ? "rgb24" : "y4m");
+    return v;
+}
+
+static int skip_y4m_frame_header(FILE *file)
+{
+    char tag[6];
+    if(fread(tag, 1, 5, file) != 5) return 0;
+    if(memcmp(tag, "FRAME", 5)) error("Corrupt Y4M stream");
+    int c;
+    while((c = fgetc(file)) != '\n'){
+        if(c == EOF) return 0;
+    }
+    return 1;
+}
+
+static float clamp_unit(float x)
+{
+    return x < 0 ? 0 : (x > 1 ? 1 : x);
+}
+
+/* BT.601 studio range, which is what ffmpeg writes for yuv420p. */
+static void yuv_to_image(video_stream *v, image im)
+{
+    int x, y;
+    int w = v->w, h = v->h;
+    size_t n = (size_t)w*h;
+    unsigned char *luma = v->buf;
+    int cw = (v->chroma == Y4M_444) ? w : (w + 1)/2;
+    int ch = (v->chroma == Y4M_444) ? h : (h + 1)/2;
+    unsigned char *u = luma + n;
+    unsigned char *vv = u + (size_t)cw*ch;
+    int shift = (v->chroma == Y4M_420);
+    for(y = 0; y < h; ++y){
+        for(x = 0; x < w; ++x){
+            size_t i = (size_t)y*w + x;
+            float l = 1.164f*(luma[i] - 16)/255.f;
+            if(v->chroma == Y4M_MONO){
+                im.data[i] = im.data[i + n] = im.data[i + 2*n] = clamp_unit(l);
+                continue;
+            }
+            size_t c = (size_t)(y >> shift)*cw + (x >> shift);
+            float cb = (u[c] - 128)/255.f;
+            float cr = (vv[c] - 128)/255.f;
+            im.data[i] = clamp_unit(l + 1.596f*cr);
+            im.data[i + n] = clamp_unit(l - .392f*cb - .813f*cr);
+            im.data[i + 2*n] = clamp_unit(l + 2.017f*cb);
+        }
+    }
+}
+
+static void rgb_to_image(video_stream *v, image im)
+{
+    size_t i, n = (size_t)v->w*v->h;
+    int k;
+    for(i = 0; i < n; ++i){
+        for(k = 0; k < 3; ++k) im.data[i + k*n] = v->buf[i*3 + k]/255.f;
+    }
+}
+
+/* Fills *im with the next frame, reallocating it if the size differs. Returns 0 at the end of the stream. */
+int read_video_frame(video_stream *v, image *im)
+{
+    if(v->chroma != RAW_RGB && !skip_y4m_frame_header(v->file)) return 0;
+    size_t got = v->pending + fread(v->buf + v->pending, 1, v->frame_bytes - v->pending, v->file);
+    v->pending = 0;
+    if(got < v->frame_bytes) return 0;
+    if(im->w != v->w || im->h != v->h || im->c != 3){
+        free_image(*im);
+        *im = make_image(v->w, v->h, 3);
+    }
+    if(v->chroma == RAW_RGB) rgb_to_image(v, *im);
+    else yuv_to_image(v, *im);
+    return 1;
+}
+
+void close_video_stream(video_stream *v)
+{
+    if(!v) return;
+    if(v->pipe){
+        if(pclose(v->file)) fprintf(stderr, "ffmpeg exited with an error\n");
+    } else if(v->file != stdin){
+        fclose(v->file);
+    }
+    free(v->buf);
+    free(v);
+}
@@ -0,0 +1,22 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdio.h>
+#include "image.h"
+
+typedef struct {
+    FILE *file;
+    int pipe;
+    int w;
+    int h;
+    int chroma;
+    size_t frame_bytes;
+    size_t pending;
+    unsigned char *buf;
+} video_stream;
+
+video_stream *open_video_stream(char *filename, int w, int h);
+int read_video_frame(video_stream *v, image *im);
+void close_video_stream(video_stream *v);
+
+#endif
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "winograd.h"
+#include "gemm.h"
+#include "blas.h"
+#include "utils.h"
+
+/* Tiles transformed and multiplied together, rounded to whole tile rows. */
+#define WINOGRAD_BLOCK 128
+
+/* F(2x2,3x3) and F(4x4,3x3) from Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks". */
+static const float BT2[4*4] = {
+    1,  0, -1,  0,
+    0,  1,  1,  0,
+    0, -1,  1,  0,
+    0,  1,  0, -1
+};
+static const float G2[4*3] = {
+    1,   0,  0,
+    .5, .5, .5,
+    .5,-.5, .5,
+    0,   0,  1
+};
+static const float AT2[2*4] = {
+    1, 1,  1,  0,
+    0, 1, -1, -1
+};
+static const float BT4[6*6] = {
+    4,  0, -5,  0, 1, 0,
+    0, -4, -4,  1, 1, 0,
+    0,  4, -4, -1, 1, 0,
+    0, -2, -1,  2, 1, 0,
+    0,  2, -1, -2, 1, 0,
+    0,  4,  0, -5, 0, 1
+};
+static const float G4[6*3] = {
+    1./4,      0,     0,
+    -1./6, -1./6, -1./6,
+    -1./6,  1./6, -1./6,
+    1./24, 1./12,  1./6,
+    1./24,-1./12,  1./6,
+    0,         0,     1
+};
+static const float AT4[4*6] = {
+    1, 1,  1, 1,  1, 0,
+    0, 1, -1, 2, -2, 0,
+    0, 1,  1, 4,  4, 0,
+    0, 1, -1, 8, -8, 1
+};
+
+int winograd_eligible(layer l)
+{
+    return l.type == CONVOLUTIONAL && l.size == 3 && l.stride == 1 && l.groups == 1
+        && !l.binary && !l.xnor && !l.quantized && !l.half && !l.weight_updates;
+}
+
+/* Large feature maps take the 4x4 tiles; small ones waste less padding and weight memory with 2x2. */
+static int winograd_tile(layer l)
+{
+    return (l.out_w >= 24 && l.out_h >= 24) ? 4 : 2;
+}
+
+static void winograd_blocking(layer l, int *tiles_x, int *tiles_y, int *rows)
+{
+    int m = l.winograd;
+    *tiles_x = (l.out_w + m - 1) / m;
+    *tiles_y = (l.out_h + m - 1) / m;
+    *rows = WINOGRAD_BLOCK / *tiles_x;
+    if(*rows < 1) *rows = 1;
+    if(*rows > *tiles_y) *rows = *tiles_y;
+}
+
+/* Transformed inputs and products for one block of tiles, plus two scratch rows of tiles. */
+size_t winograd_workspace_size(layer l)
+{
+    int tiles_x, tiles_y, rows;
+    int a = l.winograd + 2;
+    winograd_blocking(l, &tiles_x, &tiles_y, &rows);
+    size_t p = (size_t)rows*tiles_x;
+    return ((size_t)a*a*(l.c + l.n)*p + 2*(size_t)a*a*tiles_x)*sizeof(float);
+}
+
+/* U[xi][f][c] = (G g G')[xi] for every 3x3 filter g. */
+void transform_winograd_weights(network *net, layer *l)
+{
+    int f, ch, i, j, k;
+    int m = winograd_tile(*l);
+    int a = m + 2;
+    const float *G = (m == 4) ? G4 : G2;
+    float *u = calloc((size_t)a*a*l->n*l->c, sizeof(float));
+    for(f = 0; f < l->n; ++f){
+        for(ch = 0; ch < l->c; ++ch){
+            float *g = l->weights + ((size_t)f*l->c + ch)*9;
+            float t[6*3];
+            for(i = 0; i < a; ++i){
+                for(j = 0; j < 3; ++j){
+                    t[i*3 + j] = G[i*3]*g[j] + G[i*3 + 1]*g[3 + j] + G[i*3 + 2]*g[6 + j];
+                }
+            }
+            for(i = 0; i < a; ++i){
+                for(j = 0; j < a; ++j){
+                    float s = 0;
+                    for(k = 0; k < 3; ++k) s += t[i*3 + k]*G[j*3 + k];
+                    u[((size_t)(i*a + j)*l->n + f)*l->c + ch] = s;
+                }
+            }
+        }
+    }
+    free(l->winograd_weights);
+    l->winograd_weights = u;
+    l->winograd = m;
+    reserve_layer_workspace(net, l, winograd_workspace_size(*l));
+}
+
+void transform_network_weights(network *net, int start, int cutoff)
+{
+    int i;
+#ifdef GPU
+    if(gpu_index >= 0) return;
+#endif
+    for(i = start; i < net->n && i < cutoff; ++i){
+        layer *l = net->layers + i;
+        if(!winograd_eligible(*l) || l->dontload) continue;
+        transform_winograd_weights(net, l);
+    }
+}
+
+/* out[r*rows + s][x] = sum_ij T[r][i] * in[i*a + j][x] * T[s][j] for a row of tiles. Zero
+   coefficients are skipped and the innermost loop runs across tiles so it vectorizes.
+   in is consumed before out is written, so the two may alias. */
+static void transform_tiles(const float *T, int rows, int a, int n, float *in, float *tmp, float *out, size_t stride)
+{
+    int r, s, i, x;
+    for(r = 0; r < rows; ++r){
+        for(s = 0; s < a; ++s){
+            float *t = tmp + (size_t)(r*a + s)*n;
+            memset(t, 0, n*sizeof(float));
+            for(i = 0; i < a; ++i){
+                float c = T[r*a + i];
+                float *d = in + (size_t)(i*a + s)*n;
+                if(c == 0) continue;
+                for(x = 0; x < n; ++x) t[x] += c*d[x];
+            }
+        }
+    }
+    for(r = 0; r < rows; ++r){
+        for(s = 0; s < rows; ++s){
+            float *o = out + (size_t)(r*rows + s)*stride;
+            memset(o, 0, n*sizeof(float));
+            for(i = 0; i < a; ++i){
+                float c = T[s*a + i];
+                float *t = tmp + (size_t)(r*a + i)*n;
+                if(c == 0) continue;
+                for(x = 0; x < n; ++x) o[x] += c*t[x];
+            }
+        }
+    }
+}
+
+void forward_winograd_convolution(layer l, network net)
+{
+    int b, ch, f, ty, x, i, j, xi;
+    int m = l.winograd;
+    int a = m + 2;
+    const float *BT = (m == 4) ? BT4 : BT2;
+    const float *AT = (m == 4) ? AT4 : AT2;
+    int tiles_x, tiles_y, rows;
+    winograd_blocking(l, &tiles_x, &tiles_y, &rows);
+    size_t block = (size_t)rows*tiles_x;
+    float *V = net.workspace;
+    float *M = V + (size_t)a*a*l.c*block;
+    float *d = M + (size_t)a*a*l.n*block;
+    float *t = d + (size_t)a*a*tiles_x;
+
+    for(b = 0; b < l.batch; ++b){
+        float *input = net.input + b*l.inputs;
+        float *output = l.output + b*l.outputs;
+        int ty0;
+        for(ty0 = 0; ty0 < tiles_y; ty0 += rows){
+            int nrows = (tiles_y - ty0 < rows) ? tiles_y - ty0 : rows;
+            size_t p = (size_t)nrows*tiles_x;
+            for(ch = 0; ch < l.c; ++ch){
+                float *im = input + (size_t)ch*l.h*l.w;
+                for(ty = 0; ty < nrows; ++ty){
+                    int y0 = (ty0 + ty)*m - l.pad;
+                    for(i = 0; i < a; ++i){
+                        int iy = y0 + i;
+                        for(j = 0; j < a; ++j){
+                            float *row = d + (size_t)(i*a + j)*tiles_x;
+                            for(x = 0; x < tiles_x; ++x){
+                                int ix = x*m - l.pad + j;
+                                row[x] = (iy >= 0 && iy < l.h && ix >= 0 && ix < l.w) ? im[iy*l.w + ix] : 0;
+                            }
+                        }
+                    }
+                    transform_tiles(BT, a, a, tiles_x, d, t, V + (size_t)ch*p + (size_t)ty*tiles_x, (size_t)l.c*p);
+                }
+            }
+            fill_cpu(a*a*l.n*p, 0, M, 1);
+            for(xi = 0; xi < a*a; ++xi){
+                gemm(0,0,l.n,p,l.c,1,l.winograd_weights + (size_t)xi*l.n*l.c,l.c,V + (size_t)xi*l.c*p,p,1,M + (size_t)xi*l.n*p,p);
+            }
+            for(f = 0; f < l.n; ++f){
+                for(ty = 0; ty < nrows; ++ty){
+                    for(xi = 0; xi < a*a; ++xi){
+                        memcpy(d + (size_t)xi*tiles_x, M + ((size_t)xi*l.n + f)*p + (size_t)ty*tiles_x, tiles_x*sizeof(float));
+                    }
+                    transform_tiles(AT, m, a, tiles_x, d, t, d, tiles_x);
+                    for(i = 0; i < m; ++i){
+                        int oy = (ty0 + ty)*m + i;
+                        if(oy >= l.out_h) break;
+                        float *dst = output + ((size_t)f*l.out_h + oy)*l.out_w;
+                        for(j = 0; j < m; ++j){
+                            float *src = d + (size_t)(i*m + j)*tiles_x;
+                            for(x = 0; x < tiles_x; ++x){
+                                int ox = x*m + j;
+                                if(ox < l.out_w) dst[ox] = src[x];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
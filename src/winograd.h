@@ -0,0 +1,12 @@
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+#include "network.h"
+
+int winograd_eligible(layer l);
+size_t winograd_workspace_size(layer l);
+void transform_winograd_weights(network *net, layer *l);
+void transform_network_weights(network *net, int start, int cutoff);
+void forward_winograd_convolution(layer l, network net);
+
+#endif